@@ -1,12 +1,6 @@
 #include <benchmark/benchmark.h>
 #include <algorithm>
 
-#ifdef USE_BOOST_LOCKLESS_Q
-#include "cptl.hpp"
-#else
-#include "cptl_stl.hpp"
-#endif
-
 #include "graphex.hpp"
 
 using namespace GE;
@@ -42,6 +36,34 @@ static void BM_GraphEX(benchmark::State& state)
 // Register the function as a benchmark
 BENCHMARK(BM_GraphEX);
 
+// same graph built once, then executed and reset on every iteration
+static void BM_GraphEX_Reused(benchmark::State& state)
+{
+    GraphExOptions opt;
+    opt.engine = static_cast<ExecutionEngine>(state.range(0));
+    GraphEx executor(opt);
+
+    decltype(auto) first = executor.makeNode(firstFunc);
+    decltype(auto) second = executor.makeNode(secondFunc);
+    decltype(auto) third = executor.makeNode(thirdFunc);
+    decltype(auto) fourth = executor.makeNode(fourthFunc);
+    decltype(auto) fifth = executor.makeNode(fifthFunc);
+
+    second->setParent(first);
+    third->setParent<0>(second);
+    fourth->setParent<0>(second);
+    fifth->setParent<0>(third);
+    fifth->setParent<1>(fourth);
+
+    for (auto _ : state) {
+        executor.execute();
+        executor.reset();
+    }
+}
+BENCHMARK(BM_GraphEX_Reused)
+    ->Arg(static_cast<int>(ExecutionEngine::Sequential))
+    ->Arg(static_cast<int>(ExecutionEngine::Parallel));
+
 // Define another benchmark
 static void BM_FunctionCall(benchmark::State& state)
 {
@@ -202,4 +224,340 @@ static void BM_FunctionCall_Expensive_Parallel(benchmark::State& state)
 }
 BENCHMARK(BM_FunctionCall_Expensive_Parallel);
 
+// one root fanning out to state.range(0) tiny children. Every child is
+// scheduled from a worker thread, which stresses the pool's submission path
+static void BM_GraphEX_WideFanOut(benchmark::State& state)
+{
+    GraphEx executor(4);
+
+    std::function<int(void)> rootFunc = []() -> int { return 1; };
+    std::function<int(int)> leafFunc = [](int a) -> int { return a + 1; };
+    decltype(auto) root = executor.makeNode(rootFunc);
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        decltype(auto) leaf = executor.makeNode(leafFunc);
+        leaf->setParent<0>(root);
+    }
+
+    for (auto _ : state) {
+        executor.execute();
+        executor.reset();
+    }
+    state.SetItemsProcessed(state.iterations() * (state.range(0) + 1));
+}
+BENCHMARK(BM_GraphEX_WideFanOut)->Arg(64)->Arg(1024);
+
+// a chain of state.range(0) tiny nodes, each one unblocking the next
+static void BM_GraphEX_LongChain(benchmark::State& state)
+{
+    GraphEx executor(4);
+
+    decltype(auto) prev = executor.makeNode(firstFunc);
+    for (int64_t i = 1; i < state.range(0); ++i) {
+        decltype(auto) next = executor.makeNode(firstFunc);
+        next->setParent(prev);
+        prev = next;
+    }
+
+    for (auto _ : state) {
+        executor.execute();
+        executor.reset();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GraphEX_LongChain)->Arg(64)->Arg(1024);
+
+// layers of 100 tiny nodes, every node depending on two nodes of the previous
+// layer, executed and reset on every iteration
+static void BM_GraphEX_LargeGraph(benchmark::State& state)
+{
+    constexpr int64_t width = 100;
+    GraphExOptions opt;
+    opt.concurrency = 4;
+    opt.engine = static_cast<ExecutionEngine>(state.range(1));
+    GraphEx executor(opt);
+
+    std::function<int(void)> sourceFunc = []() -> int { return 1; };
+    std::function<int(int, int)> addFunc = [](int a, int b) -> int {
+        return a + b;
+    };
+    std::vector<Node<std::function<int(int, int)>, int, int>*> layer;
+    std::vector<Node<std::function<int(int, int)>, int, int>*> nextLayer;
+    std::vector<Node<std::function<int(void)>>*> sources;
+    for (int64_t i = 0; i < width; ++i)
+        sources.push_back(executor.makeNode(sourceFunc));
+    for (int64_t i = 0; i < width; ++i) {
+        layer.push_back(executor.makeNode(addFunc));
+        layer.back()->setParent<0>(sources[i]);
+        layer.back()->setParent<1>(sources[(i + 1) % width]);
+    }
+    for (int64_t depth = 2; depth < state.range(0) / width; ++depth) {
+        nextLayer.clear();
+        for (int64_t i = 0; i < width; ++i) {
+            nextLayer.push_back(executor.makeNode(addFunc));
+            nextLayer.back()->setParent<0>(layer[i]);
+            nextLayer.back()->setParent<1>(layer[(i + 1) % width]);
+        }
+        layer.swap(nextLayer);
+    }
+    executor.compile();
+
+    for (auto _ : state) {
+        executor.execute();
+        executor.reset();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_GraphEX_LargeGraph)
+    ->Args({10'000, static_cast<int>(ExecutionEngine::Sequential)})
+    ->Args({10'000, static_cast<int>(ExecutionEngine::Parallel)})
+    ->Args({50'000, static_cast<int>(ExecutionEngine::Sequential)})
+    ->Args({50'000, static_cast<int>(ExecutionEngine::Parallel)});
+
+// cost of GraphEx::reset alone on a graph of state.range(0) nodes, which
+// should not depend on the size of the graph
+static void BM_GraphEX_Reset(benchmark::State& state)
+{
+    GraphEx executor(1);
+
+    decltype(auto) prev = executor.makeNode(firstFunc);
+    for (int64_t i = 1; i < state.range(0); ++i) {
+        decltype(auto) next = executor.makeNode(firstFunc);
+        next->setParent(prev);
+        prev = next;
+    }
+    executor.execute();
+
+    for (auto _ : state)
+        executor.reset();
+}
+BENCHMARK(BM_GraphEX_Reset)->Arg(1'000)->Arg(100'000);
+
+// building a layered graph of state.range(0) nodes and checking it for
+// cycles. With state.range(1) set, the cycles are checked while the edges are
+// added
+static void BM_GraphEX_Build(benchmark::State& state)
+{
+    constexpr int64_t width = 100;
+    const int64_t nNodes = state.range(0);
+    std::function<int(int, int)> addFunc = [](int a, int b) -> int {
+        return a + b;
+    };
+    for (auto _ : state) {
+        GraphExOptions opt;
+        opt.incrementalCycleCheck = state.range(1);
+        GraphEx executor(opt);
+        std::vector<Node<std::function<int(int, int)>, int, int>*> nodes(
+            nNodes);
+        for (int64_t i = 0; i < nNodes; ++i)
+            nodes[i] = executor.makeNode(addFunc);
+        for (int64_t i = width; i < nNodes; ++i) {
+            int64_t layer = i - i % width;
+            nodes[i]->setParent<0>(nodes[i - width]);
+            nodes[i]->setParent<1>(nodes[layer - width + (i + 1) % width]);
+        }
+        benchmark::DoNotOptimize(executor.hasCycle());
+    }
+    state.SetItemsProcessed(state.iterations() * nNodes);
+}
+BENCHMARK(BM_GraphEX_Build)
+    ->Args({10'000, false})
+    ->Args({10'000, true})
+    ->Args({100'000, false})
+    ->Args({100'000, true})
+    ->Args({1'000'000, false})
+    ->Args({1'000'000, true});
+
+// a chain of state.range(0) nodes passing an int along, run by the
+// sequential engine so that calling the tasks is most of the cost
+template <typename F>
+static void runChainOf(benchmark::State& state, F func)
+{
+    GraphEx executor;
+
+    decltype(auto) first = executor.makeNode(func);
+    decltype(auto) prev = first;
+    for (int64_t i = 1; i < state.range(0); ++i) {
+        decltype(auto) next = executor.makeNode(func);
+        next->template setParent<0>(prev);
+        prev = next;
+    }
+
+    for (auto _ : state) {
+        first->template feed<0>(0);
+        executor.execute();
+        benchmark::DoNotOptimize(prev->collect());
+        executor.reset();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_GraphEX_Chain_StdFunction(benchmark::State& state)
+{
+    runChainOf(state, std::function<int(int)>([](int a) { return a + 1; }));
+}
+BENCHMARK(BM_GraphEX_Chain_StdFunction)->Arg(1024);
+
+static void BM_GraphEX_Chain_Lambda(benchmark::State& state)
+{
+    runChainOf(state, [](int a) { return a + 1; });
+}
+BENCHMARK(BM_GraphEX_Chain_Lambda)->Arg(1024);
+
+// building a layered graph of state.range(0) named nodes, running it once
+// sequentially, then destroying it: the whole life of a large graph. Also
+// reports the memory the graph takes per node and per edge
+static void BM_GraphEX_BuildRunDestroy(benchmark::State& state)
+{
+    constexpr int64_t width = 100;
+    const int64_t nNodes = state.range(0);
+    auto add = [](int a, int b) { return a + b; };
+    MemoryReport report;
+    for (auto _ : state) {
+        GraphEx executor(1);
+        std::vector<NodeFor<decltype(add)>*> nodes(nNodes);
+        for (int64_t i = 0; i < nNodes; ++i)
+            nodes[i] = executor.makeNode(add, "layered graph node");
+        for (int64_t i = 0; i < width; ++i) {
+            nodes[i]->feed<0>(1);
+            nodes[i]->feed<1>(1);
+        }
+        for (int64_t i = width; i < nNodes; ++i) {
+            int64_t layer = i - i % width;
+            nodes[i]->setParent<0>(nodes[i - width]);
+            nodes[i]->setParent<1>(nodes[layer - width + (i + 1) % width]);
+        }
+        executor.execute();
+        benchmark::DoNotOptimize(nodes.back()->collect());
+        report = executor.memoryReport();
+    }
+    state.SetItemsProcessed(state.iterations() * nNodes);
+    state.counters["bytes/node"] = report.bytesPerNode();
+    state.counters["bytes/edge"] = report.bytesPerEdge();
+}
+BENCHMARK(BM_GraphEX_BuildRunDestroy)
+    ->Arg(100'000)
+    ->Arg(1'000'000)
+    ->Unit(benchmark::kMillisecond);
+
+// a single node gathering state.range(0) tiny parents, all started at once,
+// with the parents counted by groups (state.range(1) set) or one by one. One
+// by one, the workers keep signaling the sink concurrently, which stresses the
+// cache line of its status word
+static void BM_GraphEX_Gather(benchmark::State& state)
+{
+    GraphExOptions opt;
+    opt.concurrency = 4;
+    opt.engine = ExecutionEngine::Parallel;
+    opt.fanInThreshold = state.range(1) ? 1024 : 0;
+    GraphEx executor(opt);
+
+    std::function<int(void)> sourceFunc = []() -> int { return 1; };
+    decltype(auto) sink = executor.makeNode(firstFunc);
+    for (int64_t i = 0; i < state.range(0); ++i)
+        sink->setParent(executor.makeNode(sourceFunc));
+
+    for (auto _ : state) {
+        executor.execute();
+        executor.reset();
+    }
+    state.SetItemsProcessed(state.iterations() * (state.range(0) + 1));
+}
+BENCHMARK(BM_GraphEX_Gather)
+    ->Args({64, false})
+    ->Args({1024, false})
+    ->Args({10'000, false})
+    ->Args({10'000, true});
+
+// latency of a small graph whose nodes hop between the threads of the pool,
+// with the workers parking as soon as they are idle (state.range(0) == 0)
+// or following the default idle policy
+static void BM_GraphEX_IdlePolicy(benchmark::State& state)
+{
+    GraphExOptions opt;
+    opt.concurrency = 4;
+    opt.engine = ExecutionEngine::Parallel;
+    if (!state.range(0)) {
+        opt.idlePolicy.spin = std::chrono::nanoseconds(0);
+        opt.idlePolicy.yields = 0;
+        opt.idlePolicy.adaptive = false;
+    }
+    GraphEx executor(opt);
+
+    std::function<int(void)> rootFunc = []() -> int { return 1; };
+    std::function<int(int)> leafFunc = [](int a) -> int { return a + 1; };
+    decltype(auto) root = executor.makeNode(rootFunc);
+    for (int i = 0; i < 4; ++i) {
+        decltype(auto) leaf = executor.makeNode(leafFunc);
+        leaf->setParent<0>(root);
+        decltype(auto) next = executor.makeNode(leafFunc);
+        next->setParent<0>(leaf);
+    }
+
+    for (auto _ : state) {
+        executor.execute();
+        executor.reset();
+    }
+}
+BENCHMARK(BM_GraphEX_IdlePolicy)->Arg(false)->Arg(true);
+
+// the same fan-out, then fan-in graph on top of each queue of the pool,
+// state.range(0) being a ctpl::queue_kind
+static void BM_GraphEX_Queue(benchmark::State& state)
+{
+    GraphExOptions opt;
+    opt.concurrency = 4;
+    opt.engine = ExecutionEngine::Parallel;
+    opt.queue = static_cast<ctpl::queue_kind>(state.range(0));
+    GraphEx executor(opt);
+
+    std::function<int(void)> rootFunc = []() -> int { return 1; };
+    std::function<int(int)> leafFunc = [](int a) -> int { return a + 1; };
+    decltype(auto) root = executor.makeNode(rootFunc);
+    decltype(auto) sink = executor.makeNode(firstFunc);
+    for (int i = 0; i < 256; ++i) {
+        decltype(auto) leaf = executor.makeNode(leafFunc);
+        leaf->setParent<0>(root);
+        sink->setParent(leaf);
+    }
+
+    for (auto _ : state) {
+        executor.execute();
+        executor.reset();
+    }
+    state.SetItemsProcessed(state.iterations() * 258);
+}
+BENCHMARK(BM_GraphEX_Queue)
+    ->Arg(int(ctpl::queue_kind::mutex))
+    ->Arg(int(ctpl::queue_kind::ring))
+#ifdef CTPL_HAS_LOCKFREE_QUEUE
+    ->Arg(int(ctpl::queue_kind::lockfree))
+#endif
+    ->Arg(int(ctpl::queue_kind::work_stealing));
+
+// throughput of the queues alone: bursts of 1024 tiny functors posted from
+// outside the pool, state.range(0) being a ctpl::queue_kind
+static void BM_ThreadPool_Queue(benchmark::State& state)
+{
+    ctpl::thread_pool pool(4,
+                           ctpl::idle_policy(),
+                           static_cast<ctpl::queue_kind>(state.range(0)));
+    std::atomic<int64_t> counter = 0;
+    int64_t expected = 0;
+    for (auto _ : state) {
+        for (int i = 0; i < 1024; ++i)
+            pool.post([&counter](int) { ++counter; });
+        expected += 1024;
+        while (counter.load() != expected)
+            pool.run_one();
+    }
+    state.SetItemsProcessed(expected);
+}
+BENCHMARK(BM_ThreadPool_Queue)
+    ->Arg(int(ctpl::queue_kind::mutex))
+    ->Arg(int(ctpl::queue_kind::ring))
+#ifdef CTPL_HAS_LOCKFREE_QUEUE
+    ->Arg(int(ctpl::queue_kind::lockfree))
+#endif
+    ->Arg(int(ctpl::queue_kind::work_stealing));
+
 BENCHMARK_MAIN();
\ No newline at end of file
@@ -19,163 +19,58 @@
 #ifndef __ctpl_thread_pool_H__
 #define __ctpl_thread_pool_H__
 
-#include <atomic>
 #include <boost/lockfree/queue.hpp>
-#include <exception>
-#include <functional>
-#include <future>
-#include <memory>
-#include <mutex>
-#include <thread>
-#include <vector>
+#include <cstddef>
+
+#include "cptl_task.hpp"
 
 #ifndef _ctplThreadPoolLength_
 #define _ctplThreadPoolLength_ 100
 #endif
 
-// thread pool to run user's functors with signature
-//      ret func(int id, other_params)
-// where id is the index of the thread that runs the functor
-// ret is some return type
+// queue policy of ctpl::basic_thread_pool on top of the boost lockless queue,
+// which only holds trivial types: functors are moved to a heap record, see
+// detail::callable_task, intrusive records are queued as they are
 
 namespace ctpl {
 
-class thread_pool {
+class lockfree_queue {
 public:
-    thread_pool() : q(_ctplThreadPoolLength_) {}
-    thread_pool(int nThreads, int queueSize = _ctplThreadPoolLength_) noexcept
-        : q(queueSize)
+    lockfree_queue(int /* nThreads */, int /* nHelpers */)
+        : q(_ctplThreadPoolLength_)
     {
-        this->threads.resize(nThreads);
-        for (int i = 0; i < nThreads; ++i) {
-            this->set_thread(i);
-        }
     }
-
-    // the destructor waits for all the functions in the queue to be finished
-    ~thread_pool() { this->stop(); }
-
-    // get the number of running threads in the pool
-    int size() { return static_cast<int>(this->threads.size()); }
-
-    // number of idle threads
-    int n_idle() { return this->nWaiting; }
-    std::thread &get_thread(int i) { return *this->threads[i]; }
-
-    // empty the queue
-    void clear_queue()
+    ~lockfree_queue()
     {
-        std::function<void(int id)> *_f;
+        task *_f;
         while (this->q.pop(_f))
-            delete _f;  // empty the queue
+            if (_f->drop)
+                _f->drop(_f);
     }
 
-    // pops a functional wraper to the original function
-    std::function<void(int)> pop()
+    void push(inplace_task &&f, int /* worker */)
     {
-        std::function<void(int id)> *_f = nullptr;
-        this->q.pop(_f);
-        std::unique_ptr<std::function<void(int id)>> func(
-            _f);  // at return, delete the function even if an exception
-                  // occurred
-
-        std::function<void(int)> f;
-        if (_f)
-            f = *_f;
-        return f;
+        this->q.push(new detail::callable_task<inplace_task>(std::move(f)));
     }
-
-    // wait for all computing threads to finish and stop all threads
-    // may be called asyncronously to not pause the calling thread while waiting
-    // All the functions in the queue are run
-    void stop()
+    void push_bulk(task *const *tasks, std::size_t n, int /* worker */)
     {
-        if (this->isDone)
-            return;
-        this->isDone = true;  // give the waiting threads a command to finish
-        {
-            std::unique_lock<std::mutex> lock(this->mutex);
-            this->cv.notify_all();  // stop all waiting threads
-        }
-        for (int i = 0; i < static_cast<int>(this->threads.size());
-             ++i) {  // wait for the computing threads to finish
-            if (this->threads[i]->joinable())
-                this->threads[i]->join();
-        }
-        // if there were no threads in the pool but some functors in the queue,
-        // the functors are not deleted by the threads therefore delete them
-        // here
-        this->clear_queue();
-        this->threads.clear();
+        for (std::size_t i = 0; i < n; ++i)
+            this->q.push(tasks[i]);
     }
-
-    // run the user's function that excepts argument int - id of the running
-    // thread. returned value is templatized operator returns std::future, where
-    // the user can get the result and rethrow the catched exceptins
-    template <typename F>
-    auto push(F &&f) -> std::future<decltype(f(0))>
+    // pops at most one functor, returns the number popped
+    std::size_t pop(inplace_task *out, std::size_t /* max */, int /* worker */)
     {
-        auto pck = std::make_shared<std::packaged_task<decltype(f(0))(int)>>(
-            std::forward<F>(f));
-
-        auto _f =
-            new std::function<void(int id)>([pck](int id) { (*pck)(id); });
-        this->q.push(_f);
-
-        std::unique_lock<std::mutex> lock(this->mutex);
-        this->cv.notify_one();
-
-        return pck->get_future();
+        task *_f;
+        if (!this->q.pop(_f))
+            return 0;
+        *out = inplace_task(_f);
+        return 1;
     }
 
 private:
-    // deleted
-    thread_pool(const thread_pool &);             // = delete;
-    thread_pool(thread_pool &&);                  // = delete;
-    thread_pool &operator=(const thread_pool &);  // = delete;
-    thread_pool &operator=(thread_pool &&);       // = delete;
-
-    void set_thread(int i)
-    {
-        auto f = [this, i]() {
-            std::function<void(int id)> *_f;
-            bool isPop = this->q.pop(_f);
-            while (true) {
-                while (isPop) {  // if there is anything in the queue
-                    std::unique_ptr<std::function<void(int id)>> func(
-                        _f);  // at return, delete the function even if an
-                              // exception occurred
-                    (*_f)(i);
-                    isPop = this->q.pop(_f);
-                }
-
-                // the queue is empty here, wait for the next command
-                std::unique_lock<std::mutex> lock(this->mutex);
-                ++this->nWaiting;
-                this->cv.wait(lock, [this, &_f, &isPop]() {
-                    isPop = this->q.pop(_f);
-                    return isPop || this->isDone;
-                });
-                --this->nWaiting;
-
-                if (!isPop)
-                    return;  // if the queue is empty and this->isDone == true
-                             // or *flag then return
-            }
-        };
-        this->threads[i].reset(
-            new std::thread(f));  // compiler may not support std::make_unique()
-    }
-
-    std::vector<std::unique_ptr<std::thread>> threads;
-    mutable boost::lockfree::queue<std::function<void(int id)> *> q;
-    std::atomic<bool> isDone = false;
-    std::atomic<int> nWaiting = 0;  // how many threads are waiting
-
-    std::mutex mutex;
-    std::condition_variable cv;
+    boost::lockfree::queue<task *> q;
 };
 
 }  // namespace ctpl
 
-#endif  // __ctpl_thread_pool_H__
\ No newline at end of file
+#endif  // __ctpl_thread_pool_H__
@@ -0,0 +1,434 @@
+/*********************************************************
+ *
+ *  Copyright (C) 2014 by Vitaliy Vitsentiy
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *********************************************************/
+
+#ifndef __ctpl_pool_H__
+#define __ctpl_pool_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "cptl_ring.hpp"
+#include "cptl_stl.hpp"
+#include "cptl_task.hpp"
+#include "cptl_ws.hpp"
+
+#if __has_include(<boost/lockfree/queue.hpp>)
+#include "cptl.hpp"
+#define CTPL_HAS_LOCKFREE_QUEUE 1
+#elif defined(USE_BOOST_LOCKLESS_Q)
+#error "USE_BOOST_LOCKLESS_Q requires boost/lockfree/queue.hpp"
+#endif
+
+// thread pool to run user's functors with signature
+//      ret func(int id, other_params)
+// where id is the index of the thread that runs the functor
+// ret is some return type
+//
+// basic_thread_pool<Queue> is the pool on top of one queue policy, known at
+// compile time. thread_pool picks the queue at runtime, see queue_kind.
+// A queue policy provides
+//      Queue(int nThreads, int nHelpers);
+//      void push(inplace_task &&f, int worker);
+//      void push_bulk(task *const *tasks, std::size_t n, int worker);
+//      std::size_t pop(inplace_task *out, std::size_t max, int worker);
+// where worker is the index of the calling thread in the pool, -1 for a thread
+// outside of the pool, and pop takes up to max functors, returning how many.
+// nHelpers is the number of threads outside of the pool that also take
+// functors, with run_one
+
+namespace ctpl {
+
+template <typename Queue>
+class basic_thread_pool {
+public:
+    basic_thread_pool() noexcept : basic_thread_pool(0) {}
+    basic_thread_pool(int nThreads,
+                      idle_policy policy = idle_policy(),
+                      int nHelpers = 0) noexcept
+        : policy(policy), q(nThreads, nHelpers)
+    {
+        this->threads.resize(nThreads);
+        for (int i = 0; i < nThreads; ++i) {
+            this->set_thread(i);
+        }
+    }
+
+    // the destructor waits for all the functions in the queue to be finished
+    ~basic_thread_pool() { this->stop(); }
+
+    // get the number of running threads in the pool
+    int size() { return static_cast<int>(this->threads.size()); }
+
+    // number of idle threads
+    int n_idle() { return this->nWaiting; }
+    std::thread &get_thread(int i) { return *this->threads[i]; }
+
+    // index of the calling thread inside this pool, -1 if the caller is not
+    // one of the pool's workers
+    int current_worker() const
+    {
+        return tlsPool == this ? tlsWorker : -1;
+    }
+
+    // empty the queue
+    void clear_queue()
+    {
+        inplace_task _f;
+        while (this->q.pop(&_f, 1, -1))
+            _f.reset();  // empty the queue
+    }
+
+    // pops a functional wrapper to the original function
+    std::function<void(int)> pop()
+    {
+        inplace_task _f;
+        this->q.pop(&_f, 1, -1);
+        std::function<void(int)> f;
+        if (_f) {  // destroys the functor if it is never called
+            auto popped = std::make_shared<inplace_task>(std::move(_f));
+            f = [popped](int id) { (*popped)(id); };
+        }
+        return f;
+    }
+
+    // run one queued function on the calling thread, if any, so that a
+    // thread outside the pool can help draining the queue.
+    // returns false if the queue was empty
+    bool run_one(int id = -1)
+    {
+        inplace_task _f;
+        if (!this->q.pop(&_f, 1, this->current_worker()))
+            return false;
+        _f(id);
+        return true;
+    }
+
+    // wait for all computing threads to finish and stop all threads
+    // may be called asynchronously to not pause the calling thread while
+    // waiting. All the functions in the queue are run.
+    void stop()
+    {
+        if (this->isDone)
+            return;
+        this->isDone = true;  // give the waiting threads a command to finish
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->cv.notify_all();  // stop all waiting threads
+        }
+        for (int i = 0; i < static_cast<int>(this->threads.size());
+             ++i) {  // wait for the computing threads to finish
+            if (this->threads[i]->joinable())
+                this->threads[i]->join();
+        }
+        // if there were no threads in the pool but some functors in the queue,
+        // the functors are not deleted by the threads therefore delete them
+        // here
+        this->clear_queue();
+        this->threads.clear();
+    }
+
+    // run the user's function that excepts argument int - id of the running
+    // thread. returned value is templatized operator returns std::future, where
+    // the user can get the result and rethrow the catched exceptins
+    template <typename F>
+    auto push(F &&f) -> std::future<decltype(f(0))>
+    {
+        auto pck = std::make_shared<std::packaged_task<decltype(f(0))(int)>>(
+            std::forward<F>(f));
+        this->post([pck](int id) { (*pck)(id); });
+        return pck->get_future();
+    }
+
+    // fire-and-forget version of push: no future and no shared state, the
+    // functor is moved into the queue, see inplace_task.
+    // Exceptions thrown by the functor are not caught
+    template <typename F,
+              typename = std::enable_if_t<std::is_invocable_v<F &, int>>>
+    void post(F &&f)
+    {
+        this->post(inplace_task(std::forward<F>(f)));
+    }
+
+    // queue an intrusive task record owned by the caller, see ctpl::task.
+    // Nothing is allocated
+    void post(task *t) { this->post_bulk(&t, 1); }
+
+    void post(inplace_task &&f)
+    {
+        this->q.push(std::move(f), this->current_worker());
+        this->notify(1);
+    }
+
+    // queue `n` intrusive task records at once, then wake up to
+    // min(n, n_idle()) sleeping threads
+    void post_bulk(task *const *tasks, std::size_t n)
+    {
+        if (n == 0)
+            return;
+        this->q.push_bulk(tasks, n, this->current_worker());
+        this->notify(n);
+    }
+
+private:
+    // deleted
+    basic_thread_pool(const basic_thread_pool &);             // = delete;
+    basic_thread_pool(basic_thread_pool &&);                  // = delete;
+    basic_thread_pool &operator=(const basic_thread_pool &);  // = delete;
+    basic_thread_pool &operator=(basic_thread_pool &&);       // = delete;
+
+    // most functors a thread takes from the queue at once
+    static constexpr std::size_t popBatch = 8;
+
+    // wake up to `n` sleeping threads, if any, minus the spinning threads that
+    // pick up the new functors instead. The fence pairs with the increments of
+    // nWaiting and nSpinning: either the thread sees the new functors, or we
+    // see it waiting and notify it
+    void notify(std::size_t n)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        n -= detail::claim_spinners(this->nSpinning, n);
+        if (n == 0)
+            return;
+        int idle = this->nWaiting.load();
+        if (idle == 0)
+            return;
+        std::unique_lock<std::mutex> lock(this->mutex);
+        if (n >= static_cast<std::size_t>(idle))
+            this->cv.notify_all();
+        else
+            while (n--)
+                this->cv.notify_one();
+    }
+
+    void set_thread(int i)
+    {
+        auto f = [this, i]() {
+            tlsPool = this;
+            tlsWorker = i;
+            inplace_task batch[popBatch];
+            std::size_t nPop = this->q.pop(batch, popBatch, i);
+            detail::idle_waiter idle(this->policy);
+            while (true) {
+                while (nPop) {  // if there is anything in the queue
+                    for (std::size_t k = 0; k < nPop; ++k) {
+                        batch[k](i);
+                        batch[k].reset();
+                    }
+                    nPop = this->q.pop(batch, popBatch, i);
+                }
+                // the queue is empty here, spin for a while
+                if (idle.wait(this->nSpinning, [this, i, &batch, &nPop]() {
+                        nPop = this->q.pop(batch, popBatch, i);
+                        return nPop != 0;
+                    }))
+                    continue;
+                // then wait for the next command
+                std::unique_lock<std::mutex> lock(this->mutex);
+                ++this->nWaiting;
+                this->cv.wait(lock, [this, i, &batch, &nPop]() {
+                    nPop = this->q.pop(batch, popBatch, i);
+                    return nPop || this->isDone;
+                });
+                --this->nWaiting;
+                if (!nPop)
+                    return;  // if the queue is empty and this->isDone == true
+                             // or *flag then return
+                idle.woken();
+            }
+        };
+        this->threads[i].reset(
+            new std::thread(f));  // compiler may not support std::make_unique()
+    }
+
+    static inline thread_local const basic_thread_pool *tlsPool = nullptr;
+    static inline thread_local int tlsWorker = -1;
+
+    std::vector<std::unique_ptr<std::thread>> threads;
+    std::atomic<bool> isDone = false;
+    idle_policy policy;
+
+    // the queue and the bookkeeping of the idle threads are written by
+    // different threads, keep each on its own cache line
+    alignas(cache_line_size) Queue q;
+    // how many threads are waiting, and how many are spinning and not
+    // claimed by a push yet, see idle_waiter
+    alignas(cache_line_size) std::atomic<int> nWaiting = 0;
+    std::atomic<int> nSpinning = 0;
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+// queue under the threads of a thread_pool:
+// - mutex: a single queue behind a mutex, see mutex_queue
+// - ring: a bounded lock-free ring, see ring_queue
+// - lockfree: the boost lockless queue, only with boost, see lockfree_queue
+// - work_stealing: one deque per thread, see work_stealing_queue
+enum class queue_kind { mutex, ring, lockfree, work_stealing };
+
+// queue of a thread_pool when none is given, the mutex queue unless the
+// program is compiled with USE_BOOST_LOCKLESS_Q or USE_WORK_STEALING_Q
+#if defined(USE_BOOST_LOCKLESS_Q)
+inline constexpr queue_kind default_queue = queue_kind::lockfree;
+#elif defined(USE_WORK_STEALING_Q)
+inline constexpr queue_kind default_queue = queue_kind::work_stealing;
+#else
+inline constexpr queue_kind default_queue = queue_kind::mutex;
+#endif
+
+namespace detail {
+// the operations of basic_thread_pool used through thread_pool
+class pool_base {
+public:
+    virtual ~pool_base() = default;
+    virtual int size() = 0;
+    virtual int n_idle() = 0;
+    virtual std::thread &get_thread(int i) = 0;
+    virtual void clear_queue() = 0;
+    virtual std::function<void(int)> pop() = 0;
+    virtual bool run_one(int id) = 0;
+    virtual void stop() = 0;
+    virtual void post(inplace_task &&f) = 0;
+    virtual void post_bulk(task *const *tasks, std::size_t n) = 0;
+};
+
+template <typename Queue>
+class pool_model final : public pool_base {
+public:
+    pool_model(int nThreads, idle_policy policy, int nHelpers)
+        : pool(nThreads, policy, nHelpers)
+    {
+    }
+
+    int size() override { return this->pool.size(); }
+    int n_idle() override { return this->pool.n_idle(); }
+    std::thread &get_thread(int i) override { return this->pool.get_thread(i); }
+    void clear_queue() override { this->pool.clear_queue(); }
+    std::function<void(int)> pop() override { return this->pool.pop(); }
+    bool run_one(int id) override { return this->pool.run_one(id); }
+    void stop() override { this->pool.stop(); }
+    void post(inplace_task &&f) override { this->pool.post(std::move(f)); }
+    void post_bulk(task *const *tasks, std::size_t n) override
+    {
+        this->pool.post_bulk(tasks, n);
+    }
+
+private:
+    basic_thread_pool<Queue> pool;
+};
+}  // namespace detail
+
+// basic_thread_pool on top of a queue chosen at runtime, so that the queues
+// can be compared within the same program. Every call goes through one
+// virtual call, use basic_thread_pool directly to avoid it
+class thread_pool {
+public:
+    thread_pool() : thread_pool(0) {}
+    // nHelpers threads outside of the pool also run functors, see run_one
+    // @throw std::invalid_argument for queue_kind::lockfree without boost
+    thread_pool(int nThreads,
+                idle_policy policy = idle_policy(),
+                queue_kind queue = default_queue,
+                int nHelpers = 0)
+        : kind(queue), impl(make_pool(nThreads, policy, queue, nHelpers))
+    {
+    }
+
+    // the destructor waits for all the functions in the queue to be finished
+    ~thread_pool() = default;
+
+    queue_kind queue() const { return this->kind; }
+
+    // see basic_thread_pool
+    int size() { return this->impl->size(); }
+    int n_idle() { return this->impl->n_idle(); }
+    std::thread &get_thread(int i) { return this->impl->get_thread(i); }
+    void clear_queue() { this->impl->clear_queue(); }
+    std::function<void(int)> pop() { return this->impl->pop(); }
+    bool run_one(int id = -1) { return this->impl->run_one(id); }
+    void stop() { this->impl->stop(); }
+
+    template <typename F>
+    auto push(F &&f) -> std::future<decltype(f(0))>
+    {
+        auto pck = std::make_shared<std::packaged_task<decltype(f(0))(int)>>(
+            std::forward<F>(f));
+        this->post([pck](int id) { (*pck)(id); });
+        return pck->get_future();
+    }
+
+    template <typename F,
+              typename = std::enable_if_t<std::is_invocable_v<F &, int>>>
+    void post(F &&f)
+    {
+        this->impl->post(inplace_task(std::forward<F>(f)));
+    }
+    void post(task *t) { this->impl->post_bulk(&t, 1); }
+    void post(inplace_task &&f) { this->impl->post(std::move(f)); }
+    void post_bulk(task *const *tasks, std::size_t n)
+    {
+        this->impl->post_bulk(tasks, n);
+    }
+
+private:
+    // deleted
+    thread_pool(const thread_pool &);             // = delete;
+    thread_pool &operator=(const thread_pool &);  // = delete;
+
+    static std::unique_ptr<detail::pool_base> make_pool(int nThreads,
+                                                        idle_policy policy,
+                                                        queue_kind queue,
+                                                        int nHelpers)
+    {
+        switch (queue) {
+        case queue_kind::ring:
+            return std::make_unique<detail::pool_model<ring_queue>>(
+                nThreads, policy, nHelpers);
+        case queue_kind::lockfree:
+#ifdef CTPL_HAS_LOCKFREE_QUEUE
+            return std::make_unique<detail::pool_model<lockfree_queue>>(
+                nThreads, policy, nHelpers);
+#else
+            throw std::invalid_argument(
+                "The lockfree queue needs boost/lockfree/queue.hpp");
+#endif
+        case queue_kind::work_stealing:
+            return std::make_unique<detail::pool_model<work_stealing_queue>>(
+                nThreads, policy, nHelpers);
+        case queue_kind::mutex:
+        default:
+            return std::make_unique<detail::pool_model<mutex_queue>>(
+                nThreads, policy, nHelpers);
+        }
+    }
+
+    queue_kind kind;
+    std::unique_ptr<detail::pool_base> impl;
+};
+
+}  // namespace ctpl
+
+#endif  // __ctpl_pool_H__
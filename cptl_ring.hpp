@@ -0,0 +1,173 @@
+/*********************************************************
+ *
+ *  Copyright (C) 2014 by Vitaliy Vitsentiy
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *********************************************************/
+
+#ifndef __ctpl_ring_thread_pool_H__
+#define __ctpl_ring_thread_pool_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "cptl_task.hpp"
+
+// number of cells of the ring, a power of 2
+#ifndef CTPL_RING_CAPACITY
+#define CTPL_RING_CAPACITY 1024
+#endif
+
+// queue policy of ctpl::basic_thread_pool on top of a bounded lock-free ring
+
+namespace ctpl {
+
+// bounded multi-producer multi-consumer ring after Dmitry Vyukov. Every cell
+// carries a sequence number which tells, for the current lap over the ring,
+// whether the cell is free for a producer or holds a record for a consumer.
+// Producers and consumers each claim a cell with a single CAS on their own
+// index, then publish it by bumping its sequence.
+// The functors are stored by value in the cells, see inplace_task, so queuing
+// a small functor or a task record does not allocate.
+// Functors that do not fit while the ring is full go to an overflow queue
+// behind a mutex. A push never blocks nor fails: the workers of the pool push
+// too, a push waiting for room could wait for itself. As long as the overflow
+// is not empty, pushes go behind it instead of taking the cells freed in the
+// meantime, and once the ring is drained the overflow moves back into it in
+// order: functors run in the order they were pushed, and producers keeping
+// the ring busy cannot hold the overflow back forever
+class ring_queue {
+public:
+    static constexpr std::size_t capacity = CTPL_RING_CAPACITY;
+
+    ring_queue(int /* nThreads */, int /* nHelpers */) : cells(capacity)
+    {
+        for (std::size_t i = 0; i < capacity; ++i)
+            this->cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    void push(inplace_task &&f, int /* worker */)
+    {
+        if (this->overflowSize.load(std::memory_order_acquire) == 0 &&
+            this->try_push(f))
+            return;
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->overflow.push_back(std::move(f));
+        this->overflowSize.fetch_add(1, std::memory_order_release);
+    }
+    void push_bulk(task *const *tasks, std::size_t n, int worker)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            this->push(inplace_task(tasks[i]), worker);
+    }
+    // pops at most one functor, returns the number popped
+    std::size_t pop(inplace_task *out, std::size_t /* max */, int /* worker */)
+    {
+        if (this->try_pop(*out))
+            return 1;
+        if (this->overflowSize.load(std::memory_order_acquire) == 0)
+            return 0;
+        std::unique_lock<std::mutex> lock(this->mutex);
+        if (this->overflow.empty())
+            return 0;
+        this->overflow.pop_front(*out);
+        // the ring is empty: what is left of the overflow goes back into it
+        std::size_t moved = 1;
+        inplace_task next;
+        while (!this->overflow.empty() &&
+               this->try_push(this->overflow.front())) {
+            this->overflow.pop_front(next);
+            ++moved;
+        }
+        this->overflowSize.fetch_sub(moved, std::memory_order_release);
+        return 1;
+    }
+
+private:
+    static constexpr std::size_t mask = capacity - 1;
+    static_assert((capacity & mask) == 0, "capacity must be a power of 2");
+
+    // a cell is written by the producer filling it and the consumer emptying
+    // it, padded so that neighbouring cells claimed by other threads at the
+    // same time never share a cache line with it
+    struct alignas(cache_line_size) cell {
+        std::atomic<std::size_t> sequence;
+        inplace_task value;
+    };
+
+    // moves `f` into the ring, leaves it untouched if the ring is full
+    bool try_push(inplace_task &f)
+    {
+        std::size_t pos = this->tail.load(std::memory_order_relaxed);
+        cell *c;
+        while (true) {
+            c = &this->cells[pos & mask];
+            std::size_t seq = c->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) -
+                        static_cast<std::intptr_t>(pos);
+            if (diff == 0) {  // the cell is free in this lap
+                if (this->tail.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)  // the cell is still taken from the last lap
+                return false;
+            else  // another producer took the cell
+                pos = this->tail.load(std::memory_order_relaxed);
+        }
+        c->value = std::move(f);
+        c->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(inplace_task &f)
+    {
+        std::size_t pos = this->head.load(std::memory_order_relaxed);
+        cell *c;
+        while (true) {
+            c = &this->cells[pos & mask];
+            std::size_t seq = c->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) -
+                        static_cast<std::intptr_t>(pos + 1);
+            if (diff == 0) {  // the cell holds a record of this lap
+                if (this->head.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)  // nothing published in the cell yet
+                return false;
+            else  // another consumer took the cell
+                pos = this->head.load(std::memory_order_relaxed);
+        }
+        f = std::move(c->value);
+        // free the cell for the producers of the next lap
+        c->sequence.store(pos + capacity, std::memory_order_release);
+        return true;
+    }
+
+    std::vector<cell> cells;
+    // producers and consumers each hammer their own index
+    alignas(cache_line_size) std::atomic<std::size_t> tail = 0;
+    alignas(cache_line_size) std::atomic<std::size_t> head = 0;
+    alignas(cache_line_size) std::atomic<std::size_t> overflowSize = 0;
+    std::mutex mutex;
+    detail::ring_buffer<inplace_task> overflow;
+};
+
+}  // namespace ctpl
+
+#endif  // __ctpl_ring_thread_pool_H__
@@ -19,184 +19,57 @@
 #ifndef __ctpl_stl_thread_pool_H__
 #define __ctpl_stl_thread_pool_H__
 
-#include <atomic>
-#include <exception>
-#include <functional>
-#include <future>
-#include <memory>
+#include <algorithm>
+#include <cstddef>
 #include <mutex>
-#include <queue>
-#include <thread>
-#include <vector>
 
-// thread pool to run user's functors with signature
-//      ret func(int id, other_params)
-// where id is the index of the thread that runs the functor
-// ret is some return type
+#include "cptl_task.hpp"
+
+// queue policy of ctpl::basic_thread_pool: a single queue shared by all the
+// threads behind a mutex
 
 namespace ctpl {
 
-namespace detail {
-template <typename T>
-class Queue {
+// every thread takes up to a batch of functors per lock, but no more than its
+// share of the queue, so that a burst still spreads over all the threads,
+// helpers included
+class mutex_queue {
 public:
-    bool push(T const &value)
+    mutex_queue(int nThreads, int nHelpers)
+        : share(static_cast<std::size_t>(std::max(nThreads + nHelpers, 1)))
     {
-        std::unique_lock<std::mutex> lock(this->mutex);
-        this->q.push(value);
-        return true;
     }
-    // deletes the retrieved element, do not use for non integral types
-    bool pop(T &v)
+
+    void push(inplace_task &&f, int /* worker */)
     {
         std::unique_lock<std::mutex> lock(this->mutex);
-        if (this->q.empty())
-            return false;
-        v = this->q.front();
-        this->q.pop();
-        return true;
+        this->q.push_back(std::move(f));
     }
-    bool empty()
+    // push all the records under a single lock
+    void push_bulk(task *const *tasks, std::size_t n, int /* worker */)
     {
         std::unique_lock<std::mutex> lock(this->mutex);
-        return this->q.empty();
+        for (std::size_t i = 0; i < n; ++i)
+            this->q.push_back(inplace_task(tasks[i]));
     }
-
-private:
-    std::queue<T> q;
-    std::mutex mutex;
-};
-}  // namespace detail
-
-class thread_pool {
-public:
-    thread_pool() noexcept = default;
-    thread_pool(int nThreads) noexcept
-    {
-        this->threads.resize(nThreads);
-        for (int i = 0; i < nThreads; ++i) {
-            this->set_thread(i);
-        }
-    }
-
-    // the destructor waits for all the functions in the queue to be finished
-    ~thread_pool() { this->stop(); }
-
-    // get the number of running threads in the pool
-    int size() { return static_cast<int>(this->threads.size()); }
-
-    // number of idle threads
-    int n_idle() { return this->nWaiting; }
-    std::thread &get_thread(int i) { return *this->threads[i]; }
-
-    // empty the queue
-    void clear_queue()
+    // pop up to `max` functors into `out`. returns the number popped
+    std::size_t pop(inplace_task *out, std::size_t max, int /* worker */)
     {
-        std::function<void(int id)> *_f;
-        while (this->q.pop(_f))
-            delete _f;  // empty the queue
-    }
-
-    // pops a functional wrapper to the original function
-    std::function<void(int)> pop()
-    {
-        std::function<void(int id)> *_f = nullptr;
-        this->q.pop(_f);
-        std::unique_ptr<std::function<void(int id)>> func(
-            _f);  // at return, delete the function even if an exception
-                  // occurred
-        std::function<void(int)> f;
-        if (_f)
-            f = *_f;
-        return f;
-    }
-
-    // wait for all computing threads to finish and stop all threads
-    // may be called asynchronously to not pause the calling thread while
-    // waiting. All the functions in the queue are run.
-    void stop()
-    {
-        if (this->isDone)
-            return;
-        this->isDone = true;  // give the waiting threads a command to finish
-        {
-            std::unique_lock<std::mutex> lock(this->mutex);
-            this->cv.notify_all();  // stop all waiting threads
-        }
-        for (int i = 0; i < static_cast<int>(this->threads.size());
-             ++i) {  // wait for the computing threads to finish
-            if (this->threads[i]->joinable())
-                this->threads[i]->join();
-        }
-        // if there were no threads in the pool but some functors in the queue,
-        // the functors are not deleted by the threads therefore delete them
-        // here
-        this->clear_queue();
-        this->threads.clear();
-    }
-
-    // run the user's function that excepts argument int - id of the running
-    // thread. returned value is templatized operator returns std::future, where
-    // the user can get the result and rethrow the catched exceptins
-    template <typename F>
-    auto push(F &&f) -> std::future<decltype(f(0))>
-    {
-        auto pck = std::make_shared<std::packaged_task<decltype(f(0))(int)>>(
-            std::forward<F>(f));
-        auto _f =
-            new std::function<void(int id)>([pck](int id) { (*pck)(id); });
-        this->q.push(_f);
         std::unique_lock<std::mutex> lock(this->mutex);
-        this->cv.notify_one();
-        return pck->get_future();
+        std::size_t n =
+            std::min(max, std::max<std::size_t>(this->q.size() / share, 1));
+        n = std::min(n, this->q.size());
+        for (std::size_t i = 0; i < n; ++i)
+            this->q.pop_front(out[i]);
+        return n;
     }
 
 private:
-    // deleted
-    thread_pool(const thread_pool &);             // = delete;
-    thread_pool(thread_pool &&);                  // = delete;
-    thread_pool &operator=(const thread_pool &);  // = delete;
-    thread_pool &operator=(thread_pool &&);       // = delete;
-
-    void set_thread(int i)
-    {
-        auto f = [this, i]() {
-            std::function<void(int id)> *_f;
-            bool isPop = this->q.pop(_f);
-            while (true) {
-                while (isPop) {  // if there is anything in the queue
-                    std::unique_ptr<std::function<void(int id)>> func(
-                        _f);  // at return, delete the function even if an
-                              // exception occurred
-                    (*_f)(i);
-                    isPop = this->q.pop(_f);
-                }
-                // the queue is empty here, wait for the next command
-                std::unique_lock<std::mutex> lock(this->mutex);
-                ++this->nWaiting;
-                this->cv.wait(lock, [this, &_f, &isPop]() {
-                    isPop = this->q.pop(_f);
-                    return isPop || this->isDone;
-                });
-                --this->nWaiting;
-                if (!isPop)
-                    return;  // if the queue is empty and this->isDone == true
-                             // or *flag then return
-            }
-        };
-        this->threads[i].reset(
-            new std::thread(f));  // compiler may not support std::make_unique()
-    }
-
-    std::vector<std::unique_ptr<std::thread>> threads;
-    detail::Queue<std::function<void(int id)> *> q;
-    std::atomic<bool> isDone = false;
-    std::atomic<int> nWaiting = 0;  // how many threads are waiting
-
+    detail::ring_buffer<inplace_task> q;
     std::mutex mutex;
-    std::condition_variable cv;
+    const std::size_t share;
 };
 
 }  // namespace ctpl
 
-#endif  // __ctpl_stl_thread_pool_H__
\ No newline at end of file
+#endif  // __ctpl_stl_thread_pool_H__
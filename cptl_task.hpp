@@ -0,0 +1,382 @@
+/*********************************************************
+ *
+ *  Copyright (C) 2014 by Vitaliy Vitsentiy
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *********************************************************/
+
+#ifndef __ctpl_task_H__
+#define __ctpl_task_H__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// task record shared by all the thread pool variants
+
+// size of the cache lines that contended data is aligned to, so that it
+// does not share a line with unrelated data (false sharing). This is what
+// std::hardware_destructive_interference_size is for, but its value depends on
+// the tuning flags of each translation unit, which makes it unsafe for the
+// layout of classes defined in headers. Define CTPL_CACHE_LINE_SIZE to
+// override the default, e.g. to 128 on Apple silicon
+#ifndef CTPL_CACHE_LINE_SIZE
+#define CTPL_CACHE_LINE_SIZE 64
+#endif
+
+namespace ctpl {
+
+inline constexpr std::size_t cache_line_size = CTPL_CACHE_LINE_SIZE;
+
+// how a worker waits once the queue is empty. It first spins for up to `spin`,
+// pausing the cpu between two looks at the queue, then yields its time slice
+// up to `yields` times, and only then parks until a push wakes it up. Pushes
+// do not wake anybody while enough workers are spinning.
+// With `adaptive`, every worker keeps an average of the time it waited for
+// its last tasks. It spins for twice that average, at most `spin`, and parks
+// right away while that average is above `spin`: spinning only pays off when
+// tasks arrive close to each other. spin == 0 and yields == 0 parks right away
+struct idle_policy {
+    std::chrono::nanoseconds spin = std::chrono::microseconds(50);
+    unsigned yields = 4;
+    bool adaptive = true;
+};
+
+// intrusive record of a fire-and-forget task, queued by pointer with
+// thread_pool::post. The pool neither allocates nor frees a record it is given:
+// whoever posts it keeps it alive until `run` has been called.
+// `run` receives the record itself and the id of the thread running it.
+// `drop`, if set, is called instead of `run` when the pool is cleared before
+// the record could run
+struct task {
+    void (*run)(task *self, int id) = nullptr;
+    void (*drop)(task *self) = nullptr;
+};
+
+namespace detail {
+// heap record owning a functor, used when posting a plain functor. It frees
+// itself after running or being dropped
+template <typename F>
+struct callable_task final : task {
+    explicit callable_task(F &&f)
+        : task{&callable_task::invoke, &callable_task::discard},
+          f(std::forward<F>(f))
+    {
+    }
+
+    static void invoke(task *self, int id)
+    {
+        std::unique_ptr<callable_task> t(
+            static_cast<callable_task *>(self));  // at return, delete the
+                                                  // record even if an
+                                                  // exception occurred
+        t->f(id);
+    }
+    static void discard(task *self)
+    {
+        delete static_cast<callable_task *>(self);
+    }
+
+    std::decay_t<F> f;
+};
+
+// hint to the cpu that the thread is spinning
+inline void cpu_relax() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// take up to `n` of the spinning workers counted by `nSpinning`, each of
+// them picks up one of `n` new tasks instead of a sleeping worker.
+// returns how many were taken
+inline std::size_t claim_spinners(std::atomic<int> &nSpinning, std::size_t n)
+{
+    int spinning = nSpinning.load();
+    while (spinning > 0) {
+        int claimed = static_cast<int>(
+            std::min<std::size_t>(static_cast<std::size_t>(spinning), n));
+        if (nSpinning.compare_exchange_weak(spinning, spinning - claimed))
+            return claimed;
+    }
+    return 0;
+}
+
+// per worker state of the idle policy
+class idle_waiter {
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit idle_waiter(const idle_policy &policy)
+        : policy(policy), average(policy.spin)
+    {
+    }
+
+    // spin, then yield, until `try_pop` succeeds or the policy says to park.
+    // The worker counts as spinning in `nSpinning` meanwhile. A push that
+    // claimed it does not wake anybody up, so a worker about to park has to
+    // look at the queue again after leaving, see the wait predicate of the
+    // pools. returns true if `try_pop` succeeded
+    template <typename TryPop>
+    bool wait(std::atomic<int> &nSpinning, TryPop &&try_pop)
+    {
+        this->start = clock::now();
+        std::chrono::nanoseconds budget = this->policy.spin;
+        if (this->policy.adaptive)
+            budget = this->average > this->policy.spin
+                         ? std::chrono::nanoseconds(0)
+                         : std::min(budget, 2 * this->average);
+        if (budget.count() == 0 &&
+            (this->policy.yields == 0 || this->policy.adaptive))
+            return false;
+
+        ++nSpinning;
+        bool isPop = false;
+        // back off exponentially between two looks at the queue, which
+        // contend with the pushes
+        for (unsigned pauses = 1; !isPop; pauses = std::min(2 * pauses, 64u)) {
+            if (clock::now() - this->start >= budget)
+                break;
+            for (unsigned k = 0; k < pauses; ++k)
+                cpu_relax();
+            isPop = try_pop();
+        }
+        for (unsigned k = 0; !isPop && k < this->policy.yields; ++k) {
+            std::this_thread::yield();
+            isPop = try_pop();
+        }
+        // leave, unless a push claimed us already
+        int spinning = nSpinning.load();
+        while (spinning > 0 &&
+               !nSpinning.compare_exchange_weak(spinning, spinning - 1))
+            ;
+        if (isPop)
+            this->woken();
+        return isPop;
+    }
+
+    // the worker got a task after waiting, either spinning or parked
+    void woken()
+    {
+        auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            clock::now() - this->start);
+        this->average += (waited - this->average) / 8;
+    }
+
+private:
+    const idle_policy policy;
+    std::chrono::nanoseconds average;  // time waited for the last tasks
+    clock::time_point start;
+};
+
+// owner of a popped record, drops it if it never ran
+struct popped_task {
+    popped_task() noexcept = default;
+    explicit popped_task(task *t) noexcept : t(t) {}
+    popped_task(popped_task &&other) noexcept
+        : t(std::exchange(other.t, nullptr))
+    {
+    }
+    popped_task &operator=(popped_task &&other) noexcept
+    {
+        std::swap(t, other.t);
+        return *this;
+    }
+    ~popped_task()
+    {
+        if (t && t->drop)
+            t->drop(t);
+    }
+    void operator()(int id)
+    {
+        task *self = std::exchange(t, nullptr);
+        if (self)
+            self->run(self, id);
+    }
+    task *t = nullptr;
+};
+}  // namespace detail
+
+// move-only owner of a functor with signature void(int id), stored by value in
+// the queues of the pools. Functors of up to `capacity` bytes that can be
+// moved without throwing are kept inline, so queuing them does not allocate.
+// Larger functors are moved to the heap
+class inplace_task {
+public:
+    static constexpr std::size_t capacity = 48;
+
+    inplace_task() noexcept = default;
+    template <typename F,
+              typename = std::enable_if_t<
+                  !std::is_same_v<std::decay_t<F>, inplace_task> &&
+                  std::is_invocable_v<std::decay_t<F> &, int>>>
+    inplace_task(F &&f)
+    {
+        using T = std::decay_t<F>;
+        if constexpr (is_inline<T>) {
+            ::new (static_cast<void *>(this->buffer)) T(std::forward<F>(f));
+            this->ops = &inline_ops<T>::table;
+        }
+        else {
+            ::new (static_cast<void *>(this->buffer))
+                T *(new T(std::forward<F>(f)));
+            this->ops = &heap_ops<T>::table;
+        }
+    }
+    // wraps an intrusive record, which is dropped if the task never runs
+    explicit inplace_task(task *t) : inplace_task(detail::popped_task(t)) {}
+
+    inplace_task(inplace_task &&other) noexcept { this->take(other); }
+    inplace_task &operator=(inplace_task &&other) noexcept
+    {
+        if (this != &other) {
+            this->reset();
+            this->take(other);
+        }
+        return *this;
+    }
+    inplace_task(const inplace_task &) = delete;
+    inplace_task &operator=(const inplace_task &) = delete;
+    ~inplace_task() { this->reset(); }
+
+    explicit operator bool() const noexcept { return this->ops != nullptr; }
+    void operator()(int id) { this->ops->invoke(this->buffer, id); }
+
+    // destroy the functor, if any
+    void reset() noexcept
+    {
+        if (this->ops) {
+            this->ops->destroy(this->buffer);
+            this->ops = nullptr;
+        }
+    }
+
+private:
+    struct ops_table {
+        void (*invoke)(void *buffer, int id);
+        void (*relocate)(void *to, void *from) noexcept;
+        void (*destroy)(void *buffer) noexcept;
+    };
+
+    template <typename T>
+    static constexpr bool is_inline =
+        sizeof(T) <= capacity && alignof(T) <= alignof(std::max_align_t) &&
+        std::is_nothrow_move_constructible_v<T>;
+
+    template <typename T>
+    struct inline_ops {
+        static void invoke(void *buffer, int id)
+        {
+            (*std::launder(static_cast<T *>(buffer)))(id);
+        }
+        static void relocate(void *to, void *from) noexcept
+        {
+            T *f = std::launder(static_cast<T *>(from));
+            ::new (to) T(std::move(*f));
+            f->~T();
+        }
+        static void destroy(void *buffer) noexcept
+        {
+            std::launder(static_cast<T *>(buffer))->~T();
+        }
+        static constexpr ops_table table{&invoke, &relocate, &destroy};
+    };
+
+    template <typename T>
+    struct heap_ops {
+        static T *&get(void *buffer)
+        {
+            return *std::launder(static_cast<T **>(buffer));
+        }
+        static void invoke(void *buffer, int id) { (*get(buffer))(id); }
+        static void relocate(void *to, void *from) noexcept
+        {
+            ::new (to) T *(get(from));
+        }
+        static void destroy(void *buffer) noexcept { delete get(buffer); }
+        static constexpr ops_table table{&invoke, &relocate, &destroy};
+    };
+
+    void take(inplace_task &other) noexcept
+    {
+        if (other.ops) {
+            other.ops->relocate(this->buffer, other.buffer);
+            this->ops = std::exchange(other.ops, nullptr);
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char buffer[capacity];
+    const ops_table *ops = nullptr;
+};
+
+namespace detail {
+// growable circular buffer backing the queues of the pools. Unlike std::deque
+// it keeps its storage once grown, so that a steady flow of push and pop
+// never allocates
+template <typename T>
+class ring_buffer {
+public:
+    bool empty() const { return this->head == this->tail; }
+    std::size_t size() const { return this->tail - this->head; }
+
+    void push_back(T &&value)
+    {
+        if (this->size() == this->slots.size())
+            this->grow();
+        this->slots[this->tail++ & this->mask] = std::move(value);
+    }
+    T &front() { return this->slots[this->head & this->mask]; }
+    void pop_front(T &value)
+    {
+        value = std::move(this->slots[this->head++ & this->mask]);
+    }
+    void pop_back(T &value)
+    {
+        value = std::move(this->slots[--this->tail & this->mask]);
+    }
+
+private:
+    void grow()
+    {
+        std::vector<T> larger(
+            std::max<std::size_t>(16, 2 * this->slots.size()));
+        std::size_t n = this->size();
+        for (std::size_t i = 0; i < n; ++i)
+            larger[i] = std::move(this->slots[(this->head + i) & this->mask]);
+        this->slots.swap(larger);
+        this->mask = this->slots.size() - 1;
+        this->head = 0;
+        this->tail = n;
+    }
+
+    std::vector<T> slots;
+    std::size_t mask = 0;
+    std::size_t head = 0;  // both only grow, slots are indexed modulo the size
+    std::size_t tail = 0;
+};
+}  // namespace detail
+
+}  // namespace ctpl
+
+#endif  // __ctpl_task_H__
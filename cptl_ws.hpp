@@ -0,0 +1,136 @@
+/*********************************************************
+ *
+ *  Copyright (C) 2014 by Vitaliy Vitsentiy
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *********************************************************/
+
+#ifndef __ctpl_ws_thread_pool_H__
+#define __ctpl_ws_thread_pool_H__
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "cptl_task.hpp"
+
+// work-stealing queue policy of ctpl::basic_thread_pool
+//
+// every worker owns a deque. Functors pushed from a worker thread go to the
+// back of that worker's deque and are popped back in LIFO order by the owner.
+// Idle workers steal from the front of the other deques (FIFO). Functors
+// pushed from outside the pool go through a shared injection queue.
+
+namespace ctpl {
+
+namespace detail {
+// deque owned by a single worker. The owner pushes and pops at the back, other
+// workers steal from the front. The lock is per worker, so it is only
+// contended while somebody is stealing from this particular worker. Aligned
+// so that the deques of two workers never share a cache line.
+// Also used as the injection queue, which is only popped from the front
+template <typename T>
+class alignas(cache_line_size) StealingDeque {
+public:
+    void push(T &&value)
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->q.push_back(std::move(value));
+    }
+    void push_bulk(task *const *tasks, std::size_t n)
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        for (std::size_t i = 0; i < n; ++i)
+            this->q.push_back(T(tasks[i]));
+    }
+    // owner side, newest element first
+    bool pop(T &v)
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        if (this->q.empty())
+            return false;
+        this->q.pop_back(v);
+        return true;
+    }
+    // thief side, oldest element first
+    bool steal(T &v)
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        if (this->q.empty())
+            return false;
+        this->q.pop_front(v);
+        return true;
+    }
+
+private:
+    ring_buffer<T> q;
+    std::mutex mutex;
+};
+}  // namespace detail
+
+class work_stealing_queue {
+public:
+    work_stealing_queue(int nThreads, int /* nHelpers */)
+    {
+        this->deques.resize(nThreads);
+        for (int i = 0; i < nThreads; ++i)
+            this->deques[i].reset(new detail::StealingDeque<inplace_task>());
+    }
+
+    // `worker` is the index of the pushing thread in the pool, -1 if the
+    // thread is not one of the pool's workers
+    void push(inplace_task &&f, int worker)
+    {
+        if (worker >= 0)
+            this->deques[worker]->push(std::move(f));
+        else
+            this->q.push(std::move(f));
+    }
+    // push all the records under a single lock
+    void push_bulk(task *const *tasks, std::size_t n, int worker)
+    {
+        if (worker >= 0)
+            this->deques[worker]->push_bulk(tasks, n);
+        else
+            this->q.push_bulk(tasks, n);
+    }
+    // a worker takes from its own deque first (LIFO), then the injection
+    // queue, then steals from the other workers (FIFO). A thread outside the
+    // pool takes from the injection queue, then steals.
+    // pops at most one functor, returns the number popped
+    std::size_t pop(inplace_task *out, std::size_t /* max */, int worker)
+    {
+        if (worker >= 0 && this->deques[worker]->pop(*out))
+            return 1;
+        if (this->q.steal(*out))
+            return 1;
+        int n = static_cast<int>(this->deques.size());
+        int first = worker >= 0 ? worker + 1 : 0;
+        for (int k = 0; k < n; ++k) {
+            int victim = (first + k) % n;
+            if (victim != worker && this->deques[victim]->steal(*out))
+                return 1;
+        }
+        return 0;
+    }
+
+private:
+    detail::StealingDeque<inplace_task> q;  // injection queue
+    std::vector<std::unique_ptr<detail::StealingDeque<inplace_task>>> deques;
+};
+
+}  // namespace ctpl
+
+#endif  // __ctpl_ws_thread_pool_H__
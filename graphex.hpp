@@ -3,24 +3,31 @@
 #ifndef GRAPH_EX_H
 #define GRAPH_EX_H
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <exception>
 #include <functional>
 #include <iostream>
-#include <list>
+#include <map>
+#include <memory>
+#include <memory_resource>
 #include <mutex>
+#include <new>
 #include <optional>
-#include <queue>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <tuple>
 #include <type_traits>
 #include <unordered_map>
-#include <unordered_set>
 #include <utility>
 #include <vector>
 
-#ifdef USE_BOOST_LOCKLESS_Q
-#include "cptl.hpp"
-#else
-#include "cptl_stl.hpp"
-#endif
+#include "cptl_pool.hpp"
 
 namespace GE {
 
@@ -32,55 +39,525 @@ namespace GE {
             throw std::logic_error(y); \
     while (0)
 
+class BaseNode;
+class GraphEx;
+template <typename T>
+class ResultPool;
+
+/// @brief see ctpl::cache_line_size
+inline constexpr size_t kCacheLineSize = ctpl::cache_line_size;
+
+namespace detail {
+/// @brief signature of a callable accepted by `GraphEx::makeNode`. Args is
+/// the std::tuple of its parameters, decayed since they are stored in the node
+/// until the node runs. A member function takes the object it is called on by
+/// pointer, as its first parameter
+template <typename F>
+struct callable_traits : callable_traits<decltype(&F::operator())> {
+    // a functor is called on itself, drop the object parameter
+    using Args = typename callable_traits<decltype(&F::operator())>::Params;
+};
+
+template <typename R, typename... A>
+struct callable_traits<R (*)(A...)> {
+    using Args = std::tuple<std::decay_t<A>...>;
+};
+template <typename R, typename... A>
+struct callable_traits<R (*)(A...) noexcept>
+    : callable_traits<R (*)(A...)> {
+};
+
+template <typename R, typename C, typename... A>
+struct callable_traits<R (C::*)(A...)> {
+    using Params = std::tuple<std::decay_t<A>...>;
+    using Args = std::tuple<C*, std::decay_t<A>...>;
+};
+template <typename R, typename C, typename... A>
+struct callable_traits<R (C::*)(A...) const> {
+    using Params = std::tuple<std::decay_t<A>...>;
+    using Args = std::tuple<const C*, std::decay_t<A>...>;
+};
+template <typename R, typename C, typename... A>
+struct callable_traits<R (C::*)(A...) noexcept>
+    : callable_traits<R (C::*)(A...)> {
+};
+template <typename R, typename C, typename... A>
+struct callable_traits<R (C::*)(A...) const noexcept>
+    : callable_traits<R (C::*)(A...) const> {
+};
+
+template <typename TaskCallback, typename ArgsTuple>
+struct node_type;
+
+/// @brief array of trivially copyable values growing in the arena of a
+/// graph. Unlike a std::pmr::vector it does not keep a pointer to its memory
+/// resource, nor 64-bit sizes: 16 bytes instead of 32. Like everything in the
+/// arena, a grown array leaves its previous buffer behind
+template <typename T>
+class ArenaVector {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+    const T* begin() const { return _data; }
+    const T* end() const { return _data + _size; }
+    uint32_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    const T& operator[](size_t i) const { return _data[i]; }
+    size_t capacity() const { return _capacity; }
+
+    void push_back(const T& value, std::pmr::memory_resource* arena)
+    {
+        if (_size == _capacity) {
+            uint32_t capacity = _capacity ? 2 * _capacity : 2;
+            T* data = static_cast<T*>(
+                arena->allocate(capacity * sizeof(T), alignof(T)));
+            if (_size)
+                std::memcpy(data, _data, _size * sizeof(T));
+            _data = data;
+            _capacity = capacity;
+        }
+        _data[_size++] = value;
+    }
+
+private:
+    T* _data = nullptr;
+    uint32_t _size = 0;
+    uint32_t _capacity = 0;
+};
+
+/// @brief hand the result of a parent over to `child` as one of its
+/// arguments, see `Node::receiveArgument`
+using DeliverFn = void (*)(BaseNode* child, void* result, bool move);
+
+/// @brief edge to a child node taking the result of its parent as one of its
+/// arguments. The delivery functions are instantiated for the type of the
+/// child and the position of the argument, so the edges alike share theirs,
+/// see `GraphEx::internDeliverFn`
+struct ArgumentEdge {
+    /// see `BaseNode::_id`
+    uint32_t child;
+    /// position in `GraphEx::_deliverFns`
+    uint32_t deliver;
+};
+
+/// @brief result of a node and the edges it is handed over along. Empty for
+/// the nodes returning void, which take no room for it
+template <typename Result>
+struct NodeOutputs {
+    std::optional<Result> _result;
+    ArenaVector<ArgumentEdge> _argumentEdges;
+};
+template <>
+struct NodeOutputs<void> {
+};
+
+/// @brief counts the bytes allocated through it, see `GraphEx::memoryReport`
+class CountingResource : public std::pmr::memory_resource {
+public:
+    explicit CountingResource(std::pmr::memory_resource* upstream)
+        : _upstream(upstream)
+    {
+    }
+
+    size_t allocated() const { return _allocated; }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        _allocated += bytes;
+        return _upstream->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        _upstream->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource* _upstream;
+    size_t _allocated = 0;
+};
+
+/// @brief memory of a single run of a graph, see `GraphEx::executionResource`.
+/// Allocating bumps a pointer and deallocating does nothing, like a
+/// std::pmr::monotonic_buffer_resource, but rewinding keeps the blocks for the
+/// next run instead of returning them upstream. A run asking for the same
+/// memory as the previous one is then served from the same blocks.
+/// Thread safe, since the nodes of a run allocate from it concurrently: the
+/// offset in the current block is bumped atomically, and the lock is only
+/// taken to move on to the next block
+class ExecutionArena : public std::pmr::memory_resource {
+public:
+    static constexpr size_t kChunkSize = 64 * 1024;
+
+    explicit ExecutionArena(
+        std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+        : _upstream(upstream)
+    {
+    }
+    ExecutionArena(const ExecutionArena&) = delete;
+    ExecutionArena& operator=(const ExecutionArena&) = delete;
+    ~ExecutionArena()
+    {
+        for (Block* block : _blocks) {
+            size_t size = block->size;
+            block->~Block();
+            _upstream->deallocate(block, sizeof(Block) + size, kChunkAlignment);
+        }
+    }
+
+    /// @brief bytes of the blocks taken from upstream, kept across rewinds
+    size_t capacity() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _capacity;
+    }
+
+    /// @brief make all the blocks available again. Whatever was allocated
+    /// since the last rewind must be gone, and nothing may allocate meanwhile
+    void rewind()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (Block* block : _blocks)
+            block->offset.store(0, std::memory_order_relaxed);
+        _current.store(_blocks.empty() ? nullptr : _blocks.front(),
+                       std::memory_order_release);
+    }
+
+private:
+    static constexpr size_t kChunkAlignment = alignof(std::max_align_t);
+
+    /// header of a block taken from upstream, its bytes follow it
+    struct alignas(kChunkAlignment) Block {
+        Block(size_t size, size_t index) : size(size), index(index) {}
+
+        char* data() { return reinterpret_cast<char*>(this + 1); }
+
+        const size_t size;
+        const size_t index;
+        std::atomic<size_t> offset{0};
+    };
+
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        Block* block = _current.load(std::memory_order_acquire);
+        while (true) {
+            if (likely(block != nullptr)) {
+                auto data = reinterpret_cast<uintptr_t>(block->data());
+                size_t offset = block->offset.load(std::memory_order_relaxed);
+                while (true) {
+                    size_t padding =
+                        (alignment - (data + offset) % alignment) % alignment;
+                    if (offset + padding + bytes > block->size)
+                        break;
+                    if (block->offset.compare_exchange_weak(
+                            offset, offset + padding + bytes,
+                            std::memory_order_relaxed))
+                        return reinterpret_cast<void*>(data + offset + padding);
+                }
+            }
+            block = nextBlock(block, bytes + alignment);
+        }
+    }
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    /// @brief the block to allocate from once `full` cannot fit an
+    /// allocation, the first following one large enough for `minSize` bytes.
+    /// The rest of the blocks skipped is wasted until the next rewind
+    Block* nextBlock(Block* full, size_t minSize)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Block* current = _current.load(std::memory_order_relaxed);
+        // another thread moved on already
+        if (current != full)
+            return current;
+        for (size_t i = full ? full->index + 1 : 0; i < _blocks.size(); ++i) {
+            if (_blocks[i]->size >= minSize) {
+                _current.store(_blocks[i], std::memory_order_release);
+                return _blocks[i];
+            }
+        }
+        size_t size = std::max({kChunkSize,
+                                minSize,
+                                _blocks.empty() ? 0 : 2 * _blocks.back()->size});
+        void* memory =
+            _upstream->allocate(sizeof(Block) + size, kChunkAlignment);
+        Block* block = new (memory) Block(size, _blocks.size());
+        _blocks.push_back(block);
+        _capacity += size;
+        _current.store(block, std::memory_order_release);
+        return block;
+    }
+
+    std::pmr::memory_resource* _upstream;
+    /// guards the blocks, taken only to move on to another block
+    mutable std::mutex _mutex;
+    std::vector<Block*> _blocks;
+    /// block allocations are currently served from
+    std::atomic<Block*> _current{nullptr};
+    size_t _capacity = 0;
+};
+}  // namespace detail
+
+/// @brief objects kept between the runs of a graph to be reused, so that a
+/// result owning a large buffer, e.g. a std::vector, does not allocate it
+/// again on every run. A node given a pool with `Node::setResultPool` releases
+/// its result of the previous run to the pool before it runs again, and its
+/// task acquires the object to return from the pool. Thread safe.
+/// Pooled objects outlive the run, so they must not allocate from
+/// `GraphEx::executionResource`
+template <typename T>
+class ResultPool {
+public:
+    /// @brief an object released earlier, or a default constructed one if
+    /// there is none
+    T acquire()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_objects.empty())
+            return T();
+        T object = std::move(_objects.back());
+        _objects.pop_back();
+        return object;
+    }
+
+    void release(T&& object)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _objects.push_back(std::move(object));
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _objects.size();
+    }
+
+private:
+    mutable std::mutex _mutex;
+    std::vector<T> _objects;
+};
+
+/// @brief lifecycle of a node within one execution of the graph. A node only
+/// moves forward, each step being a single atomic transition:
+/// - Pending: some inputs have not been published yet
+/// - Ready: all inputs are published, the node is (being) scheduled
+/// - Running: the node _task is running
+/// - Done: the node _task has finished and the children have been signaled
+enum class NodeState : uint8_t { Pending, Ready, Running, Done };
+
+/// @brief a node of the graph.
+/// The status word does not get a cache line of its own, although all the
+/// parents of a node with fewer of them than `GraphExOptions::fanInThreshold`
+/// update it, on a line shared with the other fields of the node and maybe
+/// with the neighbouring node. That is a tradeoff: padding it makes an
+/// int(int) lambda node 256 bytes instead of 96, and costs
+/// BM_GraphEX_BuildRunDestroy/1000000 264 bytes per node instead of 112 and
+/// about 430 ms instead of 275. BM_GraphEX_Gather, with 64 to 10'000 parents
+/// counted one by one, did not tell the two layouts apart on the single cpu
+/// it ran on, so what padding saves under contention is not measured. Graphs
+/// gathering many parents on many cores can lower `fanInThreshold` instead
 class BaseNode {
 public:
-    BaseNode(const char* name) noexcept : _name(name) {}
+    /// @brief run the task of a node and hand the result over to its
+    /// children. Provided by every `Node` instantiation and kept in the
+    /// execution plan, so that running a node does not go through the vtable
+    using RunFn = void (*)(BaseNode* node);
+
+    /// @param id position of the node in the graph, which edges refer to
+    /// @param nameId name of the node interned in the graph
+    BaseNode(GraphEx* executor,
+             uint32_t id,
+             uint32_t nameId,
+             size_t parentCount) noexcept
+        : _status(makeStatus(0, NodeState::Pending, parentCount)),
+          _executor(executor),
+          _parentCount(static_cast<uint32_t>(parentCount)),
+          _id(id),
+          _nameId(nameId)
+    {
+    }
     virtual ~BaseNode() noexcept = default;
 
-    virtual void execute() = 0;
-    virtual size_t getPendingCount() const = 0;
+    /// @brief Run the main _task registered by current node
+    /// After the _task is finish, call the registered callback functions.
+    /// An exception thrown by the _task is kept by the executor, which
+    /// rethrows it from `GraphEx::execute`. The node still signals its
+    /// children, and the nodes left in the run do without running their _task.
+    /// All of them are left pending, without a result to collect
+    /// @throw if the node is not in `NodeState::Ready`, i.e. some of its
+    /// inputs are not published yet or it has already run
+    /// @throw if `ReturnType` is non-copyable but there are more than 1 child
+    /// tasks that require the result object
+    void execute();
+
+    /// @brief Signal that one of the parent nodes has finished running and
+    /// published its result
+    /// @return true if that was the last input: the node is now Ready and the
+    /// caller has to schedule it
+    bool onParentCompleted();
+
     virtual void reset() = 0;
 
-    const std::string& getName() const { return _name; }
+    /// @brief number of inputs not published yet in the current run
+    size_t getPendingCount() const;
+
+    std::string_view getName() const;
+    NodeState getState() const;
 
-    /// _nextNodes contains the child nodes for current node. Those are nodes
-    /// which are signal upon the completion of the _task in current nnode
-    std::vector<BaseNode*> _nextNodes;
+    /// @brief keep the result of the node until `GraphEx::reset`, so that it
+    /// can be collected. Only needed with
+    /// `GraphExOptions::releaseIntermediates`, otherwise every result is kept
+    void markAsOutput() { _isOutput = true; }
+    bool isOutput() const { return _isOutput; }
 
 protected:
-    std::string _name;
-};
+    friend class GraphEx;
 
-class GraphEx;
+    /// @brief see `ExecutionPlan::NodeEntry`
+    virtual RunFn taskRunner() const = 0;
+
+    /// @brief the state and the pending count of a node are only meaningful
+    /// within one run of the graph, identified by the generation of the
+    /// executor which `GraphEx::reset` bumps. Both are packed with the
+    /// generation they belong to into a single status word:
+    /// generation (32 bits) | state (2 bits) | pending count (30 bits)
+    /// A node whose status is from an older generation is lazily seen as
+    /// pending on all of its inputs, so resetting the graph is O(1)
+    static constexpr uint64_t kPendingBits = 30;
+    static constexpr uint64_t kPendingMask = (uint64_t(1) << kPendingBits) - 1;
+    static constexpr uint64_t kStateMask = uint64_t(3) << kPendingBits;
+
+    static uint64_t makeStatus(uint32_t generation,
+                               NodeState state,
+                               uint64_t pendingCount)
+    {
+        return (uint64_t(generation) << 32) |
+               (uint64_t(state) << kPendingBits) | pendingCount;
+    }
+    static uint32_t generationOf(uint64_t status)
+    {
+        return static_cast<uint32_t>(status >> 32);
+    }
+    static NodeState stateOf(uint64_t status)
+    {
+        return static_cast<NodeState>((status & kStateMask) >> kPendingBits);
+    }
+    static size_t pendingOf(uint64_t status) { return status & kPendingMask; }
+
+    /// @brief pending count of the node at the start of a run
+    size_t initialPendingCount() const
+    {
+        return _parentCount - _combinedInputs;
+    }
+
+    /// @brief status of the node as seen from `generation`
+    uint64_t statusIn(uint32_t generation) const
+    {
+        return current(_status.load(std::memory_order_acquire), generation);
+    }
+    uint64_t current(uint64_t status, uint32_t generation) const
+    {
+        return generationOf(status) == generation
+                   ? status
+                   : makeStatus(
+                         generation, NodeState::Pending, initialPendingCount());
+    }
+
+    /// @brief move the node from state `from` to state `to`
+    /// @return false if the node was not in state `from`, in which case
+    /// somebody else already did the transition
+    bool transition(uint32_t generation, NodeState from, NodeState to)
+    {
+        uint64_t expected = _status.load(std::memory_order_acquire);
+        while (true) {
+            uint64_t status = current(expected, generation);
+            if (stateOf(status) != from)
+                return false;
+            uint64_t desired =
+                (status & ~kStateMask) | (uint64_t(to) << kPendingBits);
+            if (_status.compare_exchange_weak(expected,
+                                              desired,
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_acquire))
+                return true;
+        }
+    }
+
+    /// @brief count one more input as published. With `schedule`, the input
+    /// that completes a pending node also turns it Ready, in the same atomic
+    /// step
+    /// @return true if the node became Ready
+    bool consumeInput(uint32_t generation, bool schedule)
+    {
+        uint64_t expected = _status.load(std::memory_order_acquire);
+        while (true) {
+            uint64_t status = current(expected, generation);
+            GE_ENFORCE(pendingOf(status) > 0,
+                       "Node received more inputs than it expects");
+            uint64_t desired = status - 1;
+            bool ready = schedule && pendingOf(desired) == 0 &&
+                         stateOf(status) == NodeState::Pending;
+            if (ready)
+                desired = (desired & ~kStateMask) |
+                          (uint64_t(NodeState::Ready) << kPendingBits);
+            if (_status.compare_exchange_weak(expected,
+                                              desired,
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_acquire))
+                return ready;
+        }
+    }
+
+    /// written by every parent of the node when it completes
+    std::atomic<uint64_t> _status;
+
+    // fields below are only written while the graph is built
+
+    GraphEx* _executor;
+    /// number of inputs of the node: its arguments plus the parents that do
+    /// not pass any argument
+    uint32_t _parentCount;
+    /// inputs that are not counted one by one in the status of the node but
+    /// by group, see `GraphExOptions::fanInThreshold`
+    uint32_t _combinedInputs = 0;
+    /// position of the node in the graph, see `GraphEx::_nodes`
+    uint32_t _id;
+    /// see `GraphEx::internName`
+    uint32_t _nameId;
+    /// position of the node in the execution plan of the graph
+    uint32_t _index = 0;
+    /// see `markAsOutput`
+    bool _isOutput = false;
+    /// children of the node, by `_id`
+    detail::ArenaVector<uint32_t> _nextNodes;
+};
 
 template <typename TaskCallback, typename... Args>
-class Node final : public BaseNode {
+class Node final
+    : public BaseNode,
+      private detail::NodeOutputs<std::invoke_result_t<TaskCallback, Args...>> {
     friend class GraphEx;
 
 public:
     using NodeType = Node<TaskCallback, Args...>;
     using ReturnType = std::invoke_result_t<TaskCallback, Args...>;
     using ArgsStorage = std::tuple<Args...>;
-    using ResultStorage =
-        typename std::conditional_t<!std::is_void_v<ReturnType>,
-                                    ReturnType,
-                                    int /* placeholder type for void-returning
-                                           function */
-                                    >;
-    using SubscribeCallback = std::function<void(
-        typename std::conditional_t<!std::is_void_v<ReturnType>,
-                                    ReturnType,
-                                    std::false_type>)>;
-    using SubscribeNoArgCallback = std::function<void(void)>;
-
-    Node(GraphEx* executor, TaskCallback task, const char* name)
-        : BaseNode(name), _task(task), _executor(executor)
+    using ResultStorage = ReturnType;
+
+    Node(GraphEx* executor, TaskCallback task, uint32_t id, uint32_t nameId)
+        : BaseNode(executor, id, nameId, std::tuple_size<ArgsStorage>::value),
+          _task(std::move(task))
     {
     }
     ~Node() noexcept = default;
 
-    virtual size_t getPendingCount() const final { return _pendingCount; }
-
     /// @brief setParent add a node as a prequel to current node, and the
     /// result of parent node will be passed or consumed by current node once
     /// the parent node _task is done
@@ -99,17 +576,12 @@ public:
     /// nodeC->setParent<1>(*nodeA) // if result by a is passed as y or
     /// ```
     /// @param parent parent node to be added
+    /// @throw if the result of the parent is non-copyable and already passed
+    /// to another child
+    /// @throw with `GraphExOptions::incrementalCycleCheck`, if the edge would
+    /// close a cycle
     template <std::size_t idx, typename ParentTask>
-    void setParent(ParentTask* parent)
-    {
-        static_assert(
-            !std::is_same_v<typename ParentTask::ReturnType, void>,
-            "Could not record result of a function that returns void as "
-            "an argument for this task");
-        parent->addChild(std::bind(
-            &Node::onArgumentReady<idx>, this, std::placeholders::_1));
-        parent->_nextNodes.emplace_back(this);
-    }
+    void setParent(ParentTask* parent);
 
     /// @brief setParent add a node as a prequel to current node. The parent
     /// won't be passing any result needed by current node, but it still
@@ -120,69 +592,39 @@ public:
     /// nodeA->setParent(*nodeB);
     /// ```
     /// @param parent parent node to be added
+    /// @throw with `GraphExOptions::incrementalCycleCheck`, if the edge would
+    /// close a cycle
     template <typename ParentTask>
-    void setParent(ParentTask* parent)
-    {
-        incrementParentCount();
-        SubscribeNoArgCallback cb = std::bind(
-            static_cast<void (Node::*)(void)>(&Node::onArgumentReady), this);
-        parent->addChild(cb);
-        parent->_nextNodes.emplace_back(this);
-    }
-
-    /// @brief Run the main _task registered by current node
-    /// After the _task is finish, call the registered callback functions
-    /// @throw if `ReturnType` is non-copyable but there are more than 1 child
-    /// tasks that require the result object
-    virtual void execute() override;
+    void setParent(ParentTask* parent);
 
     /// @brief Retrieve the result obtained by the current node _task
     /// @throw std::runtime_error if No valid result can be retrieved in the
     /// node
     ReturnType collect()
     {
-        GE_ENFORCE(_result, "No result found in node");
+        static_assert(!std::is_void_v<ReturnType>,
+                      "Could not collect the result of a function that "
+                      "returns void");
+        GE_ENFORCE(getState() == NodeState::Done && this->_result,
+                   "No result found in node");
         if constexpr (!std::is_copy_constructible<ReturnType>::value) {
-            GE_ENFORCE(_childTasks.empty(),
+            GE_ENFORCE(this->_argumentEdges.empty(),
                        "Non copyable result could not be collected: "
                        "moved to parameters of child tasks");
-            return std::move(_result.value());
+            return std::move(this->_result.value());
         }
         else {
-            return _result.value();
-        }
-    }
-
-    /// @brief Add a callback function that will be called when the _task in
-    /// current node finished running. The object generated by the _task in
-    /// thise node will be passed to or consumed by the callback function
-    /// `child`
-    /// @param child callback function
-    void addChild(SubscribeCallback child)
-    {
-        if constexpr (!std::is_copy_constructible<ReturnType>::value) {
-            GE_ENFORCE(
-                _childTasks.empty(),
-                "Non copyable result cannot be passed to more than 1 child "
-                "process");
+            return this->_result.value();
         }
-        _childTasks.push_back(child);
     }
 
-    /// @brief Add a callback function that will be called when the _task in
-    /// current node finished running. No argument will be passed to the
-    /// callback function
-    /// @param child callback function
-    void addChild(SubscribeNoArgCallback child)
-    {
-        _noArgChildTasks.push_back(child);
-    }
+    virtual void reset() final;
 
-    virtual void reset() final
-    {
-        _result.reset();
-        _pendingCount = _parentCount;
-    }
+    /// @brief recycle the results of the node through `pool`: the result of
+    /// the previous run is released to the pool when the node runs again, or
+    /// when `GraphEx::resetAndRewind` destroys the results, instead of being
+    /// destroyed. The pool has to outlive the node
+    void setResultPool(ResultPool<ReturnType>* pool);
 
     /// @brief manually inject parameter for a single node
     /// CAUTION: This function should not be used with parameters who are
@@ -198,217 +640,1223 @@ public:
     /// the param to be injected
     /// @param arg arg to be injected
     template <size_t idx, typename ParamType>
-    void feed(ParamType arg)
+    void feed(ParamType arg);
+
+private:
+    template <typename, typename...>
+    friend class Node;
+
+    void incrementParentCount();
+
+    /// @brief see `setResultPool`, null if the node has none
+    ResultPool<ReturnType>* resultPool() const;
+
+    /// @brief destroy the result of the node, or hand it over to its pool
+    void releaseResult();
+
+    /// @brief with `GraphExOptions::releaseIntermediates`, destroy what the
+    /// node no longer needs once it ran: its arguments, and its result once
+    /// handed over to the children unless the node is an output
+    void releaseArguments();
+    void releaseConsumedResult();
+
+    /// @brief the result stays in the node once handed over to the children,
+    /// see `GraphExOptions::releaseIntermediates`
+    bool keepsResult() const;
+
+    /// @brief store the result of a parent node as the argument at `idx` of
+    /// the node `self`. The result is moved if `move` is set or if it is non
+    /// copyable, copied otherwise. It only stores the argument, the parent
+    /// signals the node with `onParentCompleted` afterwards
+    template <std::size_t idx, typename Result>
+    static void receiveArgument(BaseNode* self, void* result, bool move);
+
+    /// @brief call the _task with the arguments of the node. They are passed
+    /// as rvalues whenever the _task accepts it, since the node does not need
+    /// them anymore: parameters taken by value are moved into, and parameters
+    /// can be rvalue references
+    decltype(auto) invokeTask()
     {
-        if constexpr (!std::is_copy_constructible<ParamType>::value ||
-                      std::is_move_constructible<ParamType>::value) {
-            std::get<idx>(_args) = std::move(arg);
-        }
+        if constexpr (std::is_invocable_v<TaskCallback&, Args&&...>)
+            return std::apply(_task, std::move(_args));
         else
-            std::get<idx>(_args) = arg;
+            return std::apply(_task, _args);
+    }
+
+    /// @brief run the _task and hand the result over to the child nodes
+    void run();
+    static void runTask(BaseNode* self) { static_cast<Node*>(self)->run(); }
+    RunFn taskRunner() const final { return &Node::runTask; }
+
+    TaskCallback _task;
+    ArgsStorage _args;
+};
+
+namespace detail {
+template <typename TaskCallback, typename... Args>
+struct node_type<TaskCallback, std::tuple<Args...>> {
+    using type = Node<TaskCallback, Args...>;
+};
+}  // namespace detail
+
+/// @brief type of the node `GraphEx::makeNode` creates for a callable
+template <typename F>
+using NodeFor = typename detail::node_type<
+    std::decay_t<F>,
+    typename detail::callable_traits<std::decay_t<F>>::Args>::type;
+
+/// @brief how `GraphEx::execute` runs the nodes
+enum class ExecutionEngine : uint8_t {
+    /// Sequential if concurrency is 1, Parallel otherwise
+    Auto,
+    /// run every node on the calling thread in a precomputed topological
+    /// order, without any thread pool, lock or atomic read-modify-write
+    Sequential,
+    /// schedule nodes on the thread pool as soon as their inputs are ready
+    Parallel,
+};
 
-        --_pendingCount;
+/// @brief construction options of a GraphEx
+struct GraphExOptions {
+    /// maximum number of threads running nodes at the same time
+    size_t concurrency = 1;
+    ExecutionEngine engine = ExecutionEngine::Auto;
+    /// when set, the thread calling `GraphEx::execute` runs ready nodes itself
+    /// instead of only waiting for the pool. It counts as one of the
+    /// `concurrency` threads, so with `concurrency == 1` the whole graph runs
+    /// inline on the calling thread
+    bool callerRuns = false;
+    /// when set, `setParent` throws instead of adding an edge that would close
+    /// a cycle, so the graph is acyclic at all times. The graph keeps a
+    /// topological order of its nodes up to date while it is built. Adding an
+    /// edge is cheap as long as parents are mostly created before their
+    /// children, otherwise it costs up to the number of nodes to reorder
+    bool incrementalCycleCheck = false;
+    /// nodes with at least this many parents do not have every parent signal
+    /// them directly, which would make all the parents contend on the same
+    /// counter. The parents are split in about sqrt(parents) groups instead,
+    /// each counting its completed parents on its own cache line, and only
+    /// the last parent of a group signals the node. 0 disables it
+    size_t fanInThreshold = 1024;
+    /// how the threads of the pool wait for nodes to run, see
+    /// `ctpl::idle_policy`. By default they spin through the short gaps
+    /// between the nodes of a run and park between runs
+    ctpl::idle_policy idlePolicy;
+    /// queue of the thread pool, see `ctpl::queue_kind`. The queues can be
+    /// compared within the same program
+    ctpl::queue_kind queue = ctpl::default_queue;
+    /// when set, intermediate results do not live until `reset`: the arguments
+    /// of a node are destroyed as soon as it ran, and its result as soon as
+    /// all of its children received it, unless the node is marked with
+    /// `BaseNode::markAsOutput`. Only the results of outputs, and of nodes
+    /// passing their result to no child, can be collected then
+    bool releaseIntermediates = false;
+};
+
+/// @brief counter of the completed parents of a group, for a node with many
+/// parents, see `GraphExOptions::fanInThreshold`
+struct alignas(kCacheLineSize) FanInCounter {
+    /// generation (32 bits) | parents of the group yet to complete (32 bits).
+    /// Reset lazily at the start of every run, like the status of the nodes
+    std::atomic<uint64_t> status = 0;
+    uint32_t size = 0;
+
+    void reset(uint32_t generation)
+    {
+        status.store((uint64_t(generation) << 32) | size,
+                     std::memory_order_relaxed);
     }
 
-private:
-    void incrementParentCount()
+    /// @brief count one more parent of the group as completed
+    /// @return true for the last parent of the group
+    bool arrive(uint32_t generation)
     {
-        _parentCount++;
-        _pendingCount++;
+        uint64_t expected = status.load(std::memory_order_acquire);
+        while (true) {
+            uint64_t current = static_cast<uint32_t>(expected >> 32) ==
+                                       generation
+                                   ? expected
+                                   : (uint64_t(generation) << 32) | size;
+            if (status.compare_exchange_weak(expected,
+                                             current - 1,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_acquire))
+                return static_cast<uint32_t>(current - 1) == 0;
+        }
     }
+};
 
-    /// @brief A register function that can be used to register callback when
-    /// parent nodes have finish running
-    template <std::size_t idx>
-    void onArgumentReady(
-        decltype(std::get<idx>(std::declval<ArgsStorage>())) arg);
-    void onArgumentReady();
+/// @brief execution plan of a graph, see `GraphEx::compile`. Only the fan-in
+/// counters change once it is built, while the graph runs.
+/// Nodes are numbered by their position in a topological order, so that every
+/// node comes after all of its parents
+struct ExecutionPlan {
+    /// @brief a node and how to run it, so that running the plan walks a
+    /// dense array instead of chasing vtables. Also the record the node is
+    /// queued to the thread pool with, which the nodes themselves do not carry
+    struct NodeEntry : ctpl::task {
+        BaseNode::RunFn runTask;
+        BaseNode* node;
+    };
 
-    TaskCallback _task;
-    ArgsStorage _args;
-    std::optional<ResultStorage> _result;
+    /// nodes in topological order
+    std::vector<NodeEntry> nodes;
+    /// children of node i, in CSR layout: they are
+    /// children[childOffsets[i]] .. children[childOffsets[i + 1] - 1]
+    std::vector<uint32_t> childOffsets;
+    std::vector<uint32_t> children;
+    /// nodes without any parent, where the execution starts
+    std::vector<uint32_t> roots;
+    /// number of edges leading to every node
+    std::vector<uint32_t> inDegrees;
 
-    size_t _parentCount = std::tuple_size<ArgsStorage>::value;
-    std::atomic<size_t> _pendingCount = std::tuple_size<ArgsStorage>::value;
+    static constexpr uint32_t kNoCounter = UINT32_MAX;
+    /// number of signals every node waits for from its parents: one per
+    /// parent, or one per group of parents for the nodes whose parents are
+    /// counted in `fanInCounters`
+    std::vector<uint32_t> signalCounts;
+    /// counter in `fanInCounters` that the edge children[k] goes through, or
+    /// `kNoCounter` if the parent signals the child directly
+    std::vector<uint32_t> childCounters;
+    std::vector<FanInCounter> fanInCounters;
+};
 
-    std::vector<SubscribeCallback> _childTasks;
-    std::vector<SubscribeNoArgCallback> _noArgChildTasks;
+/// @brief memory taken by the structure of a graph, see
+/// `GraphEx::memoryReport`
+struct MemoryReport {
+    size_t nodeCount = 0;
+    size_t edgeCount = 0;
+    /// the nodes themselves: bookkeeping, callable, arguments and result
+    size_t nodeBytes = 0;
+    /// arrays of the graph indexed by node, e.g. to look the nodes up by id
+    size_t indexBytes = 0;
+    /// interned names and the table to look them up
+    size_t nameBytes = 0;
+    /// edge arrays, including the buffers they left behind while growing
+    size_t edgeBytes = 0;
+    /// execution plan, once compiled
+    size_t planBytes = 0;
+    /// blocks reserved by `GraphEx::executionResource`, kept across runs
+    size_t executionBytes = 0;
 
-    GraphEx* _executor;
+    double bytesPerNode() const
+    {
+        return nodeCount ? double(nodeBytes + indexBytes + nameBytes) /
+                               double(nodeCount)
+                         : 0.0;
+    }
+    double bytesPerEdge() const
+    {
+        return edgeCount ? double(edgeBytes) / double(edgeCount) : 0.0;
+    }
 };
 
 class GraphEx {
 public:
-    GraphEx(size_t concurrency = 1) noexcept : _pool(concurrency) {}
+    GraphEx(size_t concurrency = 1)
+        : GraphEx(withConcurrency(concurrency))
+    {
+    }
+    /// @throw if `options.queue` is not available, see `ctpl::thread_pool`
+    GraphEx(const GraphExOptions& options)
+        : _engine(resolveEngine(options)),
+          _callerRuns(options.callerRuns),
+          _incrementalCycleCheck(options.incrementalCycleCheck),
+          _fanInThreshold(options.fanInThreshold),
+          _releaseIntermediates(options.releaseIntermediates),
+          _idlePolicy(options.idlePolicy),
+          _pool(poolSize(options),
+                options.idlePolicy,
+                options.queue,
+                options.callerRuns ? 1 : 0)
+    {
+    }
 
-    template <typename ReturnType, typename... Args>
-    Node<std::function<ReturnType(Args...)>, Args...>* makeNode(
-        std::function<ReturnType(Args...)> func,
-        const char* name = "")
+    /// @brief add a node running `func`, which can be a lambda or any other
+    /// functor with a single `operator()`, a function pointer or a member
+    /// function pointer. The callable is stored by value in the node, its
+    /// parameters are deduced from its signature. A member function takes the
+    /// object it is called on by pointer, as its first parameter
+    template <typename F>
+    NodeFor<F>* makeNode(F&& func, const char* name = "")
     {
-        _nodes.emplace_back(
-            std::make_unique<Node<std::function<ReturnType(Args...)>, Args...>>(
-                this, func, name));
-        return static_cast<Node<std::function<ReturnType(Args...)>, Args...>*>(
-            _nodes.back().get());
+        return addNode<NodeFor<F>>(std::forward<F>(func), name);
     }
 
-    template <typename... Args>
-    Node<std::function<void(Args...)>, Args...>* makeNode(
-        std::function<void(Args...)> func,
-        const char* name = "")
+    /// @brief check for cycle in the graph, in time linear in the number of
+    /// nodes and edges
+    bool hasCycle()
     {
-        _nodes.emplace_back(
-            std::make_unique<Node<std::function<void(Args...)>, Args...>>(
-                this, func, name));
-        return static_cast<Node<std::function<void(Args...)>, Args...>*>(
-            _nodes.back().get());
+        if (_plan || _incrementalCycleCheck)
+            return false;  // both imply the graph is acyclic
+        std::vector<BaseNode*> order;
+        std::vector<uint32_t> inDegrees;
+        return !sortTopologically(order, inDegrees);
     }
 
-    Node<std::function<void()>>* makeNode(std::function<void()> func,
-                                          const char* name = "")
+    /// @brief freeze the current shape of the graph into an execution plan.
+    /// The plan is kept until a node or an edge is added, `execute` compiles
+    /// the graph on demand
+    /// @throw if the graph has a cycle
+    const ExecutionPlan& compile()
     {
-        _nodes.emplace_back(
-            std::make_unique<Node<std::function<void()>>>(this, func, name));
-        return static_cast<Node<std::function<void()>>*>(_nodes.back().get());
+        if (!_plan)
+            _plan = buildPlan();
+        return *_plan;
     }
 
-    /// @brief check for cycle in the graph
-    /// assume all the relevant nodes can be checked from input nodes
-    bool hasCycle()
+    /// @brief prepare the graph for another run. This only starts a new
+    /// generation: every node is reset lazily, the first time it is touched
+    /// in the new run, so the cost does not depend on the size of the graph.
+    /// Results of the previous run are kept until they are overwritten, but
+    /// cannot be collected anymore.
+    /// The memory the previous run took from `executionResource` is kept as
+    /// well, see `resetAndRewind` to reuse it
+    void reset()
     {
-        std::unordered_map<BaseNode*, bool> col;
-        std::function<bool(BaseNode*)> dfs =
-            [&](BaseNode* currentNode) -> bool {
-            col[currentNode] = true;
-            for (auto& nextNode : currentNode->_nextNodes) {
-                if (likely(!col.count(nextNode))) {
-                    if (dfs(nextNode)) {
-                        return true;
-                    }
-                }
-                else if (unlikely(col[nextNode] == true)) {
-                    return true;
-                }
-            }
-            col[currentNode] = false;
-            return false;
-        };
-        for (auto& node : _nodes) {
-            col.clear();
-            if (dfs(node.get())) {
-                return true;
-            }
+        const bool wrapped = ++_generation == 0;
+        if (unlikely(wrapped)) {
+            // the status of a node untouched for 2^32 runs would look current
+            // again
+            for (auto& node : _nodes)
+                node->reset();
+            if (_plan)
+                for (auto& counter : _plan->fanInCounters)
+                    counter.reset(_generation);
         }
-        return false;
+        _remainingCount.store(_nodes.size(), std::memory_order_relaxed);
     }
 
-    void reset()
+    /// @brief prepare the graph for another run like `reset`, and rewind
+    /// `executionResource` so that the next run reuses its memory. The results
+    /// of the previous run, which may live there, are all destroyed first,
+    /// which costs linear time in the number of nodes
+    void resetAndRewind()
     {
-        for (auto& node : _nodes) {
+        reset();
+        for (auto& node : _nodes)
             node->reset();
-        }
-        _finishedCount = 0;
+        _executionArena.rewind();
+    }
+
+    /// @brief memory resource for the results of the nodes and the
+    /// temporaries of their tasks, e.g. a std::pmr::vector returned by a node.
+    /// Nothing is freed before `resetAndRewind`, which rewinds it so that the
+    /// next run reuses the same memory without allocating. A graph only
+    /// `reset` between runs takes more memory on every run.
+    /// Arguments and pooled results, see `ResultPool`, must not allocate from
+    /// it since they outlive the run
+    std::pmr::memory_resource* executionResource() { return &_executionArena; }
+
+    /// @brief identifier of the current run, bumped by `reset`
+    uint32_t generation() const { return _generation; }
+
+    /// @brief measure the memory the graph takes, apart from the memory the
+    /// arguments and results of the nodes own, e.g. the buffer of a
+    /// std::vector
+    MemoryReport memoryReport() const
+    {
+        MemoryReport report;
+        report.nodeCount = _nodes.size();
+        report.edgeCount = _edgeCount;
+        report.nodeBytes = _nodeMemory.allocated();
+        report.indexBytes = bytesOf(_nodes) + bytesOf(_orderIndices) +
+                            bytesOf(_prevNodes) + _orderMarks.capacity() / 8 +
+                            bytesOf(_resultPools);
+        report.nameBytes = _nameMemory.allocated();
+        report.edgeBytes = _edgeMemory.allocated();
+        report.executionBytes = _executionArena.capacity();
+        if (_plan)
+            report.planBytes =
+                bytesOf(_plan->nodes) + bytesOf(_plan->childOffsets) +
+                bytesOf(_plan->children) + bytesOf(_plan->roots) +
+                bytesOf(_plan->inDegrees) + bytesOf(_plan->signalCounts) +
+                bytesOf(_plan->childCounters) + bytesOf(_plan->fanInCounters);
+        return report;
     }
 
     /// @brief run the graph execution from input nodes
+    /// @throw if the graph has a cycle
+    /// @throw if an input node is still waiting for some of its parameters
+    /// @throw the first exception thrown by the task of a node. The run is
+    /// over by then, `reset` prepares the graph for another one
     void execute()
     {
-        std::vector<BaseNode*> initialNodes;
-        for (auto& nodePtr : _nodes)
-            if (!nodePtr->getPendingCount())
-                initialNodes.push_back(nodePtr.get());
+        const ExecutionPlan& plan = compile();
+        if (_engine == ExecutionEngine::Sequential) {
+            executeSequential(plan);
+            return;
+        }
+
+        std::vector<BaseNode*>& initialNodes = _initialNodes;
+        initialNodes.clear();
+        for (uint32_t root : plan.roots) {
+            BaseNode* node = plan.nodes[root].node;
+            uint64_t status = node->statusIn(_generation);
+            if (BaseNode::stateOf(status) != NodeState::Pending)
+                continue;  // already ran since the last reset
+            GE_ENFORCE(BaseNode::pendingOf(status) == 0,
+                       "Graph cannot complete: some nodes are still waiting "
+                       "for their inputs");
+            initialNodes.push_back(node);
+        }
         for (auto* initialNode : initialNodes)
-            _pool.push(std::bind(&BaseNode::execute, initialNode));
-        {
-            std::unique_lock<std::mutex> lock(_mutex);
-            _cv.wait(lock,
-                     [this]() { return _finishedCount == _nodes.size(); });
+            initialNode->transition(
+                _generation, NodeState::Pending, NodeState::Ready);
+        if (_callerRuns) {
+            // keep one of the roots for the calling thread
+            BaseNode* inlineNode = nullptr;
+            if (!initialNodes.empty()) {
+                inlineNode = initialNodes.back();
+                initialNodes.pop_back();
+            }
+            postNodes(initialNodes);
+            if (inlineNode)
+                runNode(inlineNode);
+            runQueuedNodes();
+        }
+        else {
+            postNodes(initialNodes);
         }
+#ifdef __cpp_lib_atomic_wait
+        for (size_t remaining = _remainingCount.load(std::memory_order_acquire);
+             remaining != 0;
+             remaining = _remainingCount.load(std::memory_order_acquire))
+            _remainingCount.wait(remaining, std::memory_order_acquire);
+#else
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this]() {
+            return _remainingCount.load(std::memory_order_acquire) == 0;
+        });
+        lock.unlock();
+#endif
+        rethrowFailure();
     }
 
-    template <typename NodeType>
-    void executeSingleNode(NodeType* node)
+    /// @brief invalidate the execution plan, called whenever a node or an
+    /// edge is added
+    void onTopologyChanged() { _plan.reset(); }
+
+    /// @brief add an edge from `parent` to `child`, called by
+    /// `Node::setParent` before anything else is changed
+    /// @throw with `GraphExOptions::incrementalCycleCheck`, if the edge would
+    /// close a cycle
+    void addEdge(BaseNode* parent, BaseNode* child)
     {
-        _pool.push(std::bind(&NodeType::execute, node));
+        if (_incrementalCycleCheck)
+            updateTopologicalOrder(parent->_id, child->_id);
+        parent->_nextNodes.push_back(child->_id, &_edgeMemory);
+        ++_edgeCount;
+        onTopologyChanged();
     }
-    void onSingleNodeCompleted()
+
+    /// @brief signal the children of a node that just ran, then count it as
+    /// completed. Only the last node of the run wakes up the thread waiting
+    /// in `execute`.
+    /// When called while a node of this graph is running on the current
+    /// thread, the last child that became ready is kept as that thread's
+    /// continuation and runs right after the current node returns, without
+    /// going through the pool. The other children that became ready are
+    /// pushed to the pool together, which wakes up at most as many idle
+    /// threads as there are children. With the work-stealing pool, nodes
+    /// pushed from a worker thread land on that worker's own deque
+    /// @param index position of the node in the execution plan
+    void onSingleNodeCompleted(uint32_t index)
     {
+        ExecutionPlan& plan = *_plan;
+        ReadyBatch batch(_pool, plan);
+        BaseNode* lastReady = nullptr;
+        for (uint32_t k = plan.childOffsets[index];
+             k < plan.childOffsets[index + 1];
+             ++k) {
+            uint32_t counter = plan.childCounters[k];
+            if (counter != ExecutionPlan::kNoCounter &&
+                !plan.fanInCounters[counter].arrive(_generation))
+                continue;
+            BaseNode* child = plan.nodes[plan.children[k]].node;
+            if (!child->onParentCompleted())
+                continue;
+            if (lastReady)
+                batch.push(lastReady);
+            lastReady = child;
+        }
+        // the last child unblocked is kept as the continuation of the thread,
+        // the one it displaces goes to the pool with the others
+        if (lastReady && _frame && _frame->executor == this)
+            std::swap(lastReady, _frame->continuation);
+        if (lastReady)
+            batch.push(lastReady);
+        batch.flush();
+
+        if (_remainingCount.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+#ifdef __cpp_lib_atomic_wait
+        _remainingCount.notify_all();
+#else
         std::unique_lock<std::mutex> lock(_mutex);
-        ++_finishedCount;
         _cv.notify_all();
+#endif
     }
 
 private:
-    ctpl::thread_pool _pool;
-    std::list<std::unique_ptr<BaseNode>> _nodes;
+    friend class BaseNode;
+    template <typename, typename...>
+    friend class Node;
+
+    /// @brief bookkeeping of the node currently running on a thread, used to
+    /// hand a newly ready child over to the same thread
+    struct ExecutionFrame {
+        GraphEx* executor;
+        BaseNode* continuation;
+    };
+
+    /// @brief nodes that became ready together, pushed to the pool in batches
+    /// of up to `kSize` with `ctpl::thread_pool::post_bulk`. Lives on the
+    /// stack, so that scheduling nodes never allocates
+    class ReadyBatch {
+    public:
+        static constexpr size_t kSize = 64;
+
+        ReadyBatch(ctpl::thread_pool& pool, ExecutionPlan& plan)
+            : _pool(pool), _plan(plan)
+        {
+        }
+
+        void push(BaseNode* node)
+        {
+            _tasks[_size++] = &_plan.nodes[node->_index];
+            if (_size == kSize)
+                flush();
+        }
+        void flush()
+        {
+            _pool.post_bulk(_tasks, _size);
+            _size = 0;
+        }
+
+    private:
+        ctpl::thread_pool& _pool;
+        ExecutionPlan& _plan;
+        ctpl::task* _tasks[kSize];
+        size_t _size = 0;
+    };
+
+    static GraphExOptions withConcurrency(size_t concurrency)
+    {
+        GraphExOptions options;
+        options.concurrency = concurrency;
+        return options;
+    }
+
+    static ExecutionEngine resolveEngine(const GraphExOptions& options)
+    {
+        if (options.engine != ExecutionEngine::Auto)
+            return options.engine;
+        return options.concurrency <= 1 ? ExecutionEngine::Sequential
+                                        : ExecutionEngine::Parallel;
+    }
+
+    static int poolSize(const GraphExOptions& options)
+    {
+        if (resolveEngine(options) == ExecutionEngine::Sequential)
+            return 0;
+        if (options.callerRuns)
+            return static_cast<int>(
+                std::max<size_t>(options.concurrency, 1) - 1);
+        return static_cast<int>(options.concurrency);
+    }
+
+    template <typename T, typename Allocator>
+    static size_t bytesOf(const std::vector<T, Allocator>& v)
+    {
+        return v.capacity() * sizeof(T);
+    }
+
+    /// @brief sort the nodes in topological order with Kahn's algorithm
+    /// @param order nodes in topological order
+    /// @param inDegrees number of edges leading to every node, by `_id`
+    /// @return false if the graph has a cycle, `order` is incomplete then
+    bool sortTopologically(std::vector<BaseNode*>& order,
+                           std::vector<uint32_t>& inDegrees)
+    {
+        const size_t nodeCount = _nodes.size();
+        inDegrees.assign(nodeCount, 0);
+        for (auto& node : _nodes)
+            for (uint32_t nextNode : node->_nextNodes)
+                ++inDegrees[nextNode];
+
+        order.clear();
+        order.reserve(nodeCount);
+        std::vector<uint32_t> remaining = inDegrees;
+        for (auto& node : _nodes)
+            if (!remaining[node->_id])
+                order.push_back(node.get());
+        for (size_t i = 0; i < order.size(); ++i)
+            for (uint32_t nextNode : order[i]->_nextNodes)
+                if (--remaining[nextNode] == 0)
+                    order.push_back(_nodes[nextNode].get());
+        return order.size() == nodeCount;
+    }
+
+    /// @brief keep the topological order of the nodes valid when the edge
+    /// parent -> child is added (Pearce and Kelly). Nothing moves if the child
+    /// already comes after the parent. Otherwise only the nodes placed
+    /// between the two that are reachable from the child, or lead to the
+    /// parent, are renumbered: the latter are moved before the former, into
+    /// the positions they occupied together
+    /// @throw if the parent is reachable from the child
+    void updateTopologicalOrder(uint32_t parent, uint32_t child)
+    {
+        const uint32_t lo = _orderIndices[child];
+        const uint32_t hi = _orderIndices[parent];
+        GE_ENFORCE(lo != hi, "Edge would close a cycle in the graph");
+        if (lo < hi) {
+            std::vector<uint32_t> forward;
+            std::vector<uint32_t> backward;
+            auto children = [this](uint32_t node) -> const auto& {
+                return _nodes[node]->_nextNodes;
+            };
+            auto parents = [this](uint32_t node) -> const auto& {
+                return _prevNodes[node];
+            };
+            bool isAcyclic =
+                searchBetween(child, children, lo, hi, parent, forward);
+            if (isAcyclic)
+                searchBetween(parent, parents, lo, hi, child, backward);
+            for (uint32_t node : forward)
+                _orderMarks[_orderIndices[node]] = false;
+            for (uint32_t node : backward)
+                _orderMarks[_orderIndices[node]] = false;
+            GE_ENFORCE(isAcyclic, "Edge would close a cycle in the graph");
+
+            auto byOrder = [this](uint32_t a, uint32_t b) {
+                return _orderIndices[a] < _orderIndices[b];
+            };
+            std::sort(backward.begin(), backward.end(), byOrder);
+            std::sort(forward.begin(), forward.end(), byOrder);
+            std::vector<uint32_t> positions;
+            positions.reserve(backward.size() + forward.size());
+            for (uint32_t node : backward)
+                positions.push_back(_orderIndices[node]);
+            for (uint32_t node : forward)
+                positions.push_back(_orderIndices[node]);
+            std::inplace_merge(positions.begin(),
+                               positions.begin() + backward.size(),
+                               positions.end());
+            size_t k = 0;
+            for (uint32_t node : backward)
+                _orderIndices[node] = positions[k++];
+            for (uint32_t node : forward)
+                _orderIndices[node] = positions[k++];
+        }
+        _prevNodes[child].push_back(parent, &_edgeMemory);
+    }
+
+    /// @brief collect `start` and the nodes reachable from it along the
+    /// edges given by `edgesOf` whose position is strictly between `lo` and
+    /// `hi`, marking them in `_orderMarks`
+    /// @return false if `target` is reachable, the search stops there
+    template <typename EdgesOf>
+    bool searchBetween(uint32_t start,
+                       EdgesOf edgesOf,
+                       uint32_t lo,
+                       uint32_t hi,
+                       uint32_t target,
+                       std::vector<uint32_t>& visited)
+    {
+        _orderMarks[_orderIndices[start]] = true;
+        visited.push_back(start);
+        for (size_t i = 0; i < visited.size(); ++i) {
+            for (uint32_t nextNode : edgesOf(visited[i])) {
+                if (nextNode == target)
+                    return false;
+                uint32_t order = _orderIndices[nextNode];
+                if (order <= lo || order >= hi || _orderMarks[order])
+                    continue;
+                _orderMarks[order] = true;
+                visited.push_back(nextNode);
+            }
+        }
+        return true;
+    }
+
+    /// @brief number the nodes in topological order and lay the edges out
+    /// in CSR form
+    /// @throw if the graph has a cycle
+    ExecutionPlan buildPlan()
+    {
+        const size_t nodeCount = _nodes.size();
+        std::vector<BaseNode*> order;
+        std::vector<uint32_t> inDegrees;
+        if (!sortTopologically(order, inDegrees))
+            throw std::logic_error("Graph has a cycle");
+
+        // renumber the nodes by their topological position
+        ExecutionPlan plan;
+        plan.nodes.reserve(nodeCount);
+        plan.inDegrees.resize(nodeCount);
+        for (size_t i = 0; i < nodeCount; ++i) {
+            BaseNode* node = order[i];
+            plan.nodes.push_back(
+                {{&GraphEx::runPoolTask, nullptr}, node->taskRunner(), node});
+            plan.inDegrees[i] = inDegrees[node->_id];
+        }
+        for (size_t i = 0; i < nodeCount; ++i) {
+            order[i]->_index = static_cast<uint32_t>(i);
+            if (!plan.inDegrees[i])
+                plan.roots.push_back(static_cast<uint32_t>(i));
+        }
+
+        plan.childOffsets.reserve(nodeCount + 1);
+        plan.childOffsets.push_back(0);
+        for (auto* node : order) {
+            for (uint32_t nextNode : node->_nextNodes)
+                plan.children.push_back(_nodes[nextNode]->_index);
+            plan.childOffsets.push_back(
+                static_cast<uint32_t>(plan.children.size()));
+        }
+        combineFanIns(plan);
+        return plan;
+    }
+
+    /// @brief split the parents of the nodes that have too many of them in
+    /// groups, see `GraphExOptions::fanInThreshold`. Consecutive edges go to
+    /// different groups, to spread parents completing at the same time
+    void combineFanIns(ExecutionPlan& plan)
+    {
+        const size_t nodeCount = plan.nodes.size();
+        plan.signalCounts = plan.inDegrees;
+        plan.childCounters.assign(plan.children.size(),
+                                  ExecutionPlan::kNoCounter);
+        std::vector<uint32_t> firstCounter(nodeCount,
+                                           ExecutionPlan::kNoCounter);
+        uint32_t counterCount = 0;
+        for (size_t i = 0; i < nodeCount; ++i) {
+            uint32_t inDegree = plan.inDegrees[i];
+            if (_fanInThreshold == 0 || inDegree < _fanInThreshold)
+                continue;
+            uint32_t groups = 1;
+            while (groups * groups < inDegree)
+                ++groups;
+            firstCounter[i] = counterCount;
+            plan.signalCounts[i] = groups;
+            counterCount += groups;
+        }
+
+        plan.fanInCounters = std::vector<FanInCounter>(counterCount);
+        std::vector<uint32_t> arrivals(nodeCount, 0);
+        for (size_t k = 0; k < plan.children.size(); ++k) {
+            uint32_t child = plan.children[k];
+            if (firstCounter[child] == ExecutionPlan::kNoCounter)
+                continue;
+            uint32_t counter = firstCounter[child] +
+                               arrivals[child]++ % plan.signalCounts[child];
+            plan.childCounters[k] = counter;
+            ++plan.fanInCounters[counter].size;
+        }
+        for (auto& counter : plan.fanInCounters)
+            counter.reset(_generation);
+
+        for (size_t i = 0; i < nodeCount; ++i) {
+            BaseNode* node = plan.nodes[i].node;
+            size_t combined = plan.inDegrees[i] - plan.signalCounts[i];
+            // a node already fed in the current run keeps its own count
+            uint64_t status = node->_status.load(std::memory_order_relaxed);
+            if (BaseNode::generationOf(status) == _generation &&
+                BaseNode::stateOf(status) == NodeState::Pending)
+                node->_status.store(status + node->_combinedInputs - combined,
+                                    std::memory_order_relaxed);
+            node->_combinedInputs = static_cast<uint32_t>(combined);
+        }
+    }
+
+    /// @brief run every node on the calling thread in topological order.
+    /// Nodes that already ran since the last reset are skipped
+    /// @throw if a node still waits for inputs that are not fed
+    void executeSequential(const ExecutionPlan& plan)
+    {
+        const uint64_t done =
+            BaseNode::makeStatus(_generation, NodeState::Done, 0);
+        for (size_t i = 0; i < plan.nodes.size(); ++i) {
+            const ExecutionPlan::NodeEntry& entry = plan.nodes[i];
+            uint64_t status = entry.node->statusIn(_generation);
+            if (BaseNode::stateOf(status) != NodeState::Pending)
+                continue;
+            // every signal expected from the parents accounts for one pending
+            // input, anything above is an input that should have been fed
+            GE_ENFORCE(BaseNode::pendingOf(status) == plan.signalCounts[i],
+                       "Graph cannot complete: some nodes are still waiting "
+                       "for their inputs");
+            // the results are handed over to the children, which are not
+            // signaled: they come later in the plan anyway
+            entry.runTask(entry.node);
+            entry.node->_status.store(done, std::memory_order_relaxed);
+        }
+        _remainingCount.store(0, std::memory_order_relaxed);
+    }
+
+    template <typename NodeType, typename F>
+    NodeType* addNode(F&& func, const char* name)
+    {
+        const auto id = static_cast<uint32_t>(_nodes.size());
+        void* memory =
+            _nodeMemory.allocate(sizeof(NodeType), alignof(NodeType));
+        NodePtr node(::new (memory) NodeType(
+            this, std::forward<F>(func), id, internName(name)));
+        NodeType* ret = static_cast<NodeType*>(node.get());
+        if (_incrementalCycleCheck) {
+            _orderIndices.push_back(id);
+            _prevNodes.emplace_back();
+            _orderMarks.push_back(false);
+        }
+        _nodes.emplace_back(std::move(node));
+        ++_remainingCount;
+        onTopologyChanged();
+        return ret;
+    }
+
+    /// @brief id of `name` among the names of the graph, copied into the
+    /// arena the first time it is seen. Nodes sharing a name share its copy,
+    /// id 0 is the empty name
+    uint32_t internName(const char* name)
+    {
+        std::string_view key(name);
+        if (key.empty())
+            return 0;
+        auto found = _nameIds.find(key);
+        if (found != _nameIds.end())
+            return found->second;
+        char* copy = static_cast<char*>(_nameMemory.allocate(key.size(), 1));
+        std::memcpy(copy, name, key.size());
+        const auto nameId = static_cast<uint32_t>(_names.size());
+        _names.emplace_back(copy, key.size());
+        _nameIds.emplace(_names.back(), nameId);
+        return nameId;
+    }
+
+    /// @brief position of `deliver` in `_deliverFns`, added the first time
+    /// it is seen
+    uint32_t internDeliverFn(detail::DeliverFn deliver)
+    {
+        auto found = _deliverIds.find(deliver);
+        if (found != _deliverIds.end())
+            return found->second;
+        const auto deliverId = static_cast<uint32_t>(_deliverFns.size());
+        _deliverFns.push_back(deliver);
+        _deliverIds.emplace(deliver, deliverId);
+        return deliverId;
+    }
+
+    /// @brief hand `result` over to the child of `edge`
+    void deliver(const detail::ArgumentEdge& edge, void* result, bool move)
+    {
+        _deliverFns[edge.deliver](_nodes[edge.child].get(), result, move);
+    }
+
+    /// @brief see `Node::setResultPool`
+    void setResultPool(uint32_t id, void* pool)
+    {
+        if (_resultPools.size() <= id)
+            _resultPools.resize(_nodes.size(), nullptr);
+        _resultPools[id] = pool;
+    }
+
+    /// @brief push nodes to the pool with a single call
+    void postNodes(const std::vector<BaseNode*>& nodes)
+    {
+        ReadyBatch batch(_pool, *_plan);
+        for (auto* node : nodes)
+            batch.push(node);
+        batch.flush();
+    }
 
-    size_t _finishedCount = 0;
+    /// @brief keep the first exception thrown by a task in the current run,
+    /// see `BaseNode::execute`
+    void recordFailure(std::exception_ptr exception)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_exception)
+            _exception = std::move(exception);
+        _failed.store(true, std::memory_order_release);
+    }
+
+    /// @brief throw the exception recorded in the run that just completed
+    void rethrowFailure()
+    {
+        if (likely(!_failed.load(std::memory_order_acquire)))
+            return;
+        std::exception_ptr exception;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            exception = std::exchange(_exception, nullptr);
+        }
+        _failed.store(false, std::memory_order_relaxed);
+        std::rethrow_exception(exception);
+    }
+
+    static void runPoolTask(ctpl::task* t, int /* id */)
+    {
+        BaseNode* node = static_cast<ExecutionPlan::NodeEntry*>(t)->node;
+        node->_executor->runNode(node);
+    }
+
+    /// @brief run queued nodes on the calling thread until the graph
+    /// completes. When the queue is empty, the thread waits for the nodes
+    /// the workers unblock like an idle worker would: it spins, then yields,
+    /// see `GraphExOptions::idlePolicy`. It only leaves once the policy would
+    /// park it, the remaining nodes are then run by the pool
+    /// @throw if the pool has no worker and the graph cannot complete, i.e.
+    /// some nodes are waiting for inputs that are never published
+    void runQueuedNodes()
+    {
+        using clock = std::chrono::steady_clock;
+        clock::time_point idleSince = clock::now();
+        unsigned yields = 0;
+        while (_remainingCount.load(std::memory_order_acquire) != 0) {
+            if (_pool.run_one()) {
+                idleSince = clock::now();
+                yields = 0;
+                continue;
+            }
+            if (_pool.size() == 0)
+                break;  // nobody else can publish the missing inputs
+            if (clock::now() - idleSince < _idlePolicy.spin)
+                ctpl::detail::cpu_relax();
+            else if (yields++ < _idlePolicy.yields)
+                std::this_thread::yield();
+            else
+                break;
+        }
+        GE_ENFORCE(_pool.size() > 0 ||
+                       _remainingCount.load(std::memory_order_acquire) == 0,
+                   "Graph cannot complete: some nodes are still waiting for "
+                   "their inputs");
+    }
+
+    /// @brief run a node, then keep running the continuation it leaves
+    /// behind until there is none
+    void runNode(BaseNode* node)
+    {
+        ExecutionFrame frame{this, nullptr};
+        ExecutionFrame* outerFrame = _frame;
+        _frame = &frame;
+        try {
+            while (node) {
+                node->execute();
+                node = std::exchange(frame.continuation, nullptr);
+            }
+        }
+        catch (...) {
+            _frame = outerFrame;
+            throw;
+        }
+        _frame = outerFrame;
+    }
+
+    static inline thread_local ExecutionFrame* _frame = nullptr;
+
+    /// @brief destroys a node without freeing its memory, which belongs to
+    /// the arena
+    struct NodeDeleter {
+        void operator()(BaseNode* node) const { node->~BaseNode(); }
+    };
+    using NodePtr = std::unique_ptr<BaseNode, NodeDeleter>;
+    /// size of the first block of the arena, the next ones grow geometrically
+    static constexpr size_t kArenaChunkSize = 64 * 1024;
+
+    /// memory of the nodes, of their edges and of their names, released at
+    /// once with the graph. Nothing is freed before: a grown edge array
+    /// leaves its previous buffer behind. Declared before the nodes, which
+    /// are destroyed first
+    std::pmr::monotonic_buffer_resource _arena{kArenaChunkSize};
+    /// views of the arena accounting for what it holds, see `memoryReport`
+    detail::CountingResource _nodeMemory{&_arena};
+    detail::CountingResource _edgeMemory{&_arena};
+    detail::CountingResource _nameMemory{&_arena};
+    /// interned names of the nodes, by `BaseNode::_nameId`
+    std::pmr::vector<std::string_view> _names{{std::string_view()},
+                                              &_nameMemory};
+    std::pmr::unordered_map<std::string_view, uint32_t> _nameIds{
+        &_nameMemory};
+    /// see `executionResource`. Declared before the nodes, whose results
+    /// may return memory to it when they are destroyed
+    detail::ExecutionArena _executionArena;
+    /// nodes by `BaseNode::_id`
+    std::vector<NodePtr> _nodes;
+    size_t _edgeCount = 0;
+    /// delivery functions of the argument edges, see `detail::ArgumentEdge`
+    std::pmr::vector<detail::DeliverFn> _deliverFns{&_edgeMemory};
+    std::pmr::map<detail::DeliverFn, uint32_t> _deliverIds{&_edgeMemory};
+    /// result pools by `BaseNode::_id`, see `Node::setResultPool`. Few nodes
+    /// have one, so they are kept aside, and the array only grows up to the
+    /// last node given one
+    std::vector<void*> _resultPools;
+
+    /// number of nodes that have not completed yet in the current run.
+    /// Decremented by every node, so it gets a cache line of its own
+    alignas(kCacheLineSize) std::atomic<size_t> _remainingCount = 0;
+    /// current run of the graph, nodes from an older run are stale. Read by
+    /// every node
+    alignas(kCacheLineSize) uint32_t _generation = 0;
+    /// set once a task of the current run threw. Read by every node
+    std::atomic<bool> _failed = false;
     std::mutex _mutex;
     std::condition_variable _cv;
+    /// see `recordFailure`, guarded by `_mutex`
+    std::exception_ptr _exception;
+
+    const ExecutionEngine _engine;
+    const bool _callerRuns;
+    const bool _incrementalCycleCheck;
+    const size_t _fanInThreshold;
+    const bool _releaseIntermediates;
+    /// how the calling thread waits for nodes with `callerRuns`
+    const ctpl::idle_policy _idlePolicy;
+    // only with `GraphExOptions::incrementalCycleCheck`, by `BaseNode::_id`:
+
+    /// position of every node in the topological order maintained while the
+    /// graph is built
+    std::vector<uint32_t> _orderIndices;
+    /// parents of every node
+    std::vector<detail::ArenaVector<uint32_t>> _prevNodes;
+    /// scratch marks of `updateTopologicalOrder`, by position in the order
+    std::vector<bool> _orderMarks;
+
+    /// built on demand by `compile`, dropped whenever the graph changes
+    std::optional<ExecutionPlan> _plan;
+    /// roots to start the current run with, kept to not allocate on every run
+    std::vector<BaseNode*> _initialNodes;
+
+    /// declared last so that it is destroyed first: the workers are joined
+    /// before the nodes and the completion primitives they use go away
+    ctpl::thread_pool _pool;
 };
 
+inline std::string_view BaseNode::getName() const
+{
+    return _executor->_names[_nameId];
+}
+
+inline size_t BaseNode::getPendingCount() const
+{
+    return pendingOf(statusIn(_executor->generation()));
+}
+
+inline NodeState BaseNode::getState() const
+{
+    return stateOf(statusIn(_executor->generation()));
+}
+
+inline bool BaseNode::onParentCompleted()
+{
+    return consumeInput(_executor->generation(), true);
+}
+
+inline void BaseNode::execute()
+{
+    const uint32_t generation = _executor->generation();
+    GE_ENFORCE(transition(generation, NodeState::Ready, NodeState::Running),
+               "Node is not ready to be executed");
+    // once a task threw, the rest of the run is only drained
+    bool ran = false;
+    if (likely(!_executor->_failed.load(std::memory_order_relaxed))) {
+        try {
+            _executor->_plan->nodes[_index].runTask(this);
+            ran = true;
+        }
+        catch (...) {
+            _executor->recordFailure(std::current_exception());
+        }
+    }
+    if (likely(ran))
+        _status.store(makeStatus(generation, NodeState::Done, 0),
+                      std::memory_order_release);
+    else
+        // like with the Sequential engine, where the run stops at the task
+        // that threw, the node is left pending without any result
+        reset();
+
+    // Execution completed here
+    _executor->onSingleNodeCompleted(_index);
+}
+
 template <typename TaskCallback, typename... Args>
-template <std::size_t idx>
-void Node<TaskCallback, Args...>::onArgumentReady(
-    decltype(std::get<idx>(std::declval<std::tuple<Args...>>())) arg)
+template <std::size_t idx, typename ParentTask>
+void Node<TaskCallback, Args...>::setParent(ParentTask* parent)
 {
-    if constexpr (!std::is_copy_constructible<decltype(arg)>::value) {
+    static_assert(!std::is_same_v<typename ParentTask::ReturnType, void>,
+                  "Could not record result of a function that returns void as "
+                  "an argument for this task");
+    using ParentResult = typename ParentTask::ResultStorage;
+    if constexpr (!std::is_copy_constructible<ParentResult>::value) {
+        GE_ENFORCE(parent->_argumentEdges.empty(),
+                   "Non copyable result cannot be passed to more than 1 child "
+                   "process");
+    }
+    _executor->addEdge(parent, this);
+    parent->_argumentEdges.push_back(
+        {_id,
+         _executor->internDeliverFn(&Node::receiveArgument<idx, ParentResult>)},
+        &_executor->_edgeMemory);
+}
+
+template <typename TaskCallback, typename... Args>
+template <typename ParentTask>
+void Node<TaskCallback, Args...>::setParent(ParentTask* parent)
+{
+    _executor->addEdge(parent, this);
+    incrementParentCount();
+}
+
+template <typename TaskCallback, typename... Args>
+template <size_t idx, typename ParamType>
+void Node<TaskCallback, Args...>::feed(ParamType arg)
+{
+    if constexpr (!std::is_copy_constructible<ParamType>::value ||
+                  std::is_move_constructible<ParamType>::value) {
         std::get<idx>(_args) = std::move(arg);
     }
     else
         std::get<idx>(_args) = arg;
 
-    if (--_pendingCount == 0)
-        _executor->executeSingleNode(this);
+    consumeInput(_executor->generation(), false);
+}
+
+template <typename TaskCallback, typename... Args>
+void Node<TaskCallback, Args...>::reset()
+{
+    releaseResult();
+    _status.store(
+        makeStatus(_executor->generation(),
+                   NodeState::Pending,
+                   initialPendingCount()),
+        std::memory_order_release);
+}
+
+template <typename TaskCallback, typename... Args>
+void Node<TaskCallback, Args...>::setResultPool(ResultPool<ReturnType>* pool)
+{
+    static_assert(!std::is_void_v<ReturnType>,
+                  "Could not recycle the result of a function that "
+                  "returns void");
+    _executor->setResultPool(_id, pool);
+}
+
+template <typename TaskCallback, typename... Args>
+auto Node<TaskCallback, Args...>::resultPool() const -> ResultPool<ReturnType>*
+{
+    const auto& pools = _executor->_resultPools;
+    return _id < pools.size()
+               ? static_cast<ResultPool<ReturnType>*>(pools[_id])
+               : nullptr;
+}
+
+template <typename TaskCallback, typename... Args>
+void Node<TaskCallback, Args...>::releaseResult()
+{
+    if constexpr (!std::is_void_v<ReturnType>) {
+        auto& result = this->_result;
+        if (result)
+            if (auto* pool = resultPool())
+                pool->release(std::move(result.value()));
+        result.reset();
+    }
+}
+
+template <typename TaskCallback, typename... Args>
+void Node<TaskCallback, Args...>::releaseArguments()
+{
+    if constexpr (!std::is_trivially_destructible_v<ArgsStorage>) {
+        if (_executor->_releaseIntermediates)
+            _args = ArgsStorage();
+    }
 }
 
 template <typename TaskCallback, typename... Args>
-void Node<TaskCallback, Args...>::onArgumentReady()
+bool Node<TaskCallback, Args...>::keepsResult() const
 {
-    if (--_pendingCount == 0)
-        _executor->executeSingleNode(this);
+    return !_executor->_releaseIntermediates || _isOutput;
 }
 
 template <typename TaskCallback, typename... Args>
-void Node<TaskCallback, Args...>::execute()
+void Node<TaskCallback, Args...>::releaseConsumedResult()
+{
+    // every child copied or moved the result into its arguments while the
+    // node ran, which makes the node the last one to hold it
+    if (!keepsResult())
+        releaseResult();
+}
+
+template <typename TaskCallback, typename... Args>
+void Node<TaskCallback, Args...>::incrementParentCount()
+{
+    GE_ENFORCE(_parentCount < kPendingMask, "Node has too many parents");
+    ++_parentCount;
+    // a node already touched in the current run keeps its own pending count
+    uint64_t status = _status.load(std::memory_order_acquire);
+    if (generationOf(status) == _executor->generation())
+        _status.fetch_add(1, std::memory_order_acq_rel);
+}
+
+template <typename TaskCallback, typename... Args>
+template <std::size_t idx, typename Result>
+void Node<TaskCallback, Args...>::receiveArgument(BaseNode* self,
+                                                  void* value,
+                                                  bool move)
+{
+    auto& arg = std::get<idx>(static_cast<Node*>(self)->_args);
+    auto& result = *static_cast<Result*>(value);
+    if constexpr (!std::is_copy_constructible<Result>::value) {
+        arg = std::move(result);
+    }
+    else if (move)
+        arg = std::move(result);
+    else
+        arg = result;
+}
+
+template <typename TaskCallback, typename... Args>
+void Node<TaskCallback, Args...>::run()
 {
-    // wait for result to be ready
-    // clang-format off
-    while (_pendingCount > 0);
-    // clang-format on
     if constexpr (std::is_void_v<ReturnType>) {
-        if constexpr (!std::is_copy_constructible<decltype(_args)>::value) {
-            std::apply(_task, std::move(_args));
-        }
-        else
-            std::apply(_task, _args);
+        invokeTask();
+        releaseArguments();
     }
     else {
+        auto& result = this->_result;
+        auto& argumentEdges = this->_argumentEdges;
+        // the result of the previous run goes back to the pool, for the task
+        // to reuse
+        if (resultPool())
+            releaseResult();
         if constexpr (!std::is_copy_constructible<ReturnType>::value) {
             GE_ENFORCE(
-                _childTasks.size() <= 1,
+                argumentEdges.size() <= 1,
                 "Internal Error: More than 1 child process for "
                 "non-copyable object");  // TODO: should just fail brutally here
-            _result = std::apply(_task, std::move(_args));
-            if (!_childTasks.empty()) {
-                _childTasks[0](std::move(_result.value()));
-                _result.reset();
+            result = invokeTask();
+            releaseArguments();
+            if (!argumentEdges.empty()) {
+                _executor->deliver(argumentEdges[0], &result.value(), true);
+                result.reset();
             }
         }
         else {
-            _result = std::apply(_task, _args);
-            for (size_t i = 0; i < _childTasks.size(); ++i) {
-                _childTasks[i](_result.value());
+            result = invokeTask();
+            releaseArguments();
+            // copied to every child but the last one, which takes the result
+            // over unless the node keeps it
+            const uint32_t edgeCount = argumentEdges.size();
+            const bool moveToLast = !keepsResult();
+            for (uint32_t i = 0; i < edgeCount; ++i) {
+                _executor->deliver(argumentEdges[i],
+                                   &result.value(),
+                                   moveToLast && i + 1 == edgeCount);
             }
+            if (edgeCount)
+                releaseConsumedResult();
         }
     }
-
-    for (auto childTask : _noArgChildTasks)
-        childTask();
-
-    // Execution completed here
-    _executor->onSingleNodeCompleted();
 }
 
 }  // namespace GE
@@ -1,11 +1,43 @@
 #include "graphex.hpp"
 #include "gtest/gtest.h"
+#include <array>
+#include <cstdlib>
+#include <new>
 
 using namespace GE;
 
+// number of allocations made by the whole process, to check that the hot paths
+// do not allocate. Not inlined, otherwise gcc warns about the malloc/free
+// pairs it sees behind new and delete
+static std::atomic<size_t> allocationCount = 0;
+
+[[gnu::noinline]] void* operator new(std::size_t size)
+{
+    ++allocationCount;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+[[gnu::noinline]] void operator delete(void* p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
 class GraphExTest : public ::testing::Test {
 };
 
+// queues the thread pool can run on in this build, see ctpl::queue_kind
+static std::vector<ctpl::queue_kind> availableQueues()
+{
+    return {ctpl::queue_kind::mutex,
+            ctpl::queue_kind::ring,
+#ifdef CTPL_HAS_LOCKFREE_QUEUE
+            ctpl::queue_kind::lockfree,
+#endif
+            ctpl::queue_kind::work_stealing};
+}
+
 TEST_F(GraphExTest, ShouldBeAbleToRunSimpleChainGraph)
 {
     GraphEx executor;
@@ -62,16 +94,12 @@ TEST_F(GraphExTest, ShouldBeAbleToRunSimpleGraphWithArgumentPassing)
     decltype(auto) first =
         executor.makeNode([]() -> void { std::cout << "Running first\n"; });
 
-    // Need to explicitly set this one or compiler wont be able to deduce
-    // whether this is makeNode<void, Args..> or makeNode<ReturnType, ...>
     std::function<int(void)> secondFunc = []() -> int {
         std::cout << "Running second\nReturn 1\n";
         return 1;
     };
     decltype(auto) second = executor.makeNode(secondFunc);
 
-    // Need to explicitly create std::function, seems like
-    // template is unable to deduce the type of lambda
     std::function<int(int)> thirdFunc = [](int a) -> int {
         std::cout << "Running third\nAdding 2: a + 2 == " << a + 2 << "\n";
         return a + 2;
@@ -260,6 +288,12 @@ TEST_F(GraphExTest, ShouldThrowIfNonCopyableObjectIsPassedToMoreThanOneChild)
                   std::string("Non copyable result cannot be passed to more "
                               "than 1 child process"));
     }
+
+    // the rejected edge is not recorded
+    third->feed<0>(std::make_unique<int>(1));
+    executor.execute();
+    EXPECT_EQ(*second->collect(), 6);
+    EXPECT_EQ(*third->collect(), 9);
 }
 
 TEST_F(GraphExTest, ShouldBeAbleToAddStructMethod)
@@ -477,8 +511,6 @@ TEST_F(GraphExTest, ResetAndExecuteRepeatedly)
 
     decltype(auto) first =
         executor.makeNode([]() -> void { std::cout << "Running first\n"; });
-    // Need to explicitly set this one or compiler wont be able to deduce
-    // whether this is makeNode<void, Args..> or makeNode<ReturnType, ...>
     std::function<int(void)> secondFunc = []() -> int { return 1; };
     decltype(auto) second = executor.makeNode(secondFunc);
     std::function<int(int)> thirdFunc = [](int a) -> int { return a + 2; };
@@ -535,6 +567,1172 @@ TEST_F(GraphExTest, ShouldBeAbleToInjectParameterManually)
     EXPECT_EQ(fifth->collect(), 22);
 }
 
+TEST_F(GraphExTest, ShouldBeAbleToRunWideFanOutGraph)
+{
+    constexpr int nChildren = 1'000;
+    GraphEx executor(4);
+
+    std::function<int(void)> rootFunc = []() -> int { return 1; };
+    decltype(auto) root = executor.makeNode(rootFunc);
+
+    std::atomic<int> sum = 0;
+    std::function<void(int)> leafFunc = [&sum](int a) -> void { sum += a; };
+    for (int i = 0; i < nChildren; ++i) {
+        decltype(auto) leaf = executor.makeNode(leafFunc);
+        leaf->setParent<0>(root);
+    }
+
+    for (int run = 1; run <= 3; ++run) {
+        executor.execute();
+        EXPECT_EQ(sum, run * nChildren);
+        executor.reset();
+    }
+}
+
+TEST_F(GraphExTest, ShouldRunChainOnSingleThread)
+{
+    constexpr int chainLength = 16;
+    GraphEx executor(4);
+
+    std::vector<std::thread::id> threadIds(chainLength);
+    auto record = [&threadIds](int i) {
+        threadIds[i] = std::this_thread::get_id();
+    };
+    decltype(auto) prev = executor.makeNode(record);
+    prev->feed<0>(0);
+    for (int i = 1; i < chainLength; ++i) {
+        decltype(auto) next = executor.makeNode(record);
+        next->feed<0>(i);
+        next->setParent(prev);
+        prev = next;
+    }
+
+    executor.execute();
+    // every node is handed over as a continuation of its parent
+    for (int i = 1; i < chainLength; ++i)
+        EXPECT_EQ(threadIds[i], threadIds[0]);
+}
+
+TEST_F(GraphExTest, ThreadPoolShouldRunPostedTasks)
+{
+    struct CountingTask : ctpl::task {
+        std::atomic<int>* counter;
+    };
+    std::atomic<int> counter = 0;
+    std::vector<CountingTask> records(100);
+    {
+        ctpl::thread_pool pool(4);
+        for (auto& record : records) {
+            record.run = [](ctpl::task* self, int) {
+                ++*static_cast<CountingTask*>(self)->counter;
+            };
+            record.counter = &counter;
+            pool.post(&record);
+        }
+        for (int i = 0; i < 100; ++i)
+            pool.post([&counter](int) { ++counter; });
+    }  // the pool runs everything still queued before stopping
+    EXPECT_EQ(counter, 200);
+}
+
+TEST_F(GraphExTest, ThreadPoolShouldRunBulkPostedTasks)
+{
+    struct CountingTask : ctpl::task {
+        std::atomic<int>* counter;
+    };
+    std::atomic<int> counter = 0;
+    std::vector<CountingTask> records(1000);
+    std::vector<ctpl::task*> batch;
+    for (auto& record : records) {
+        record.run = [](ctpl::task* self, int) {
+            ++*static_cast<CountingTask*>(self)->counter;
+        };
+        record.counter = &counter;
+        batch.push_back(&record);
+    }
+    {
+        ctpl::thread_pool pool(4);
+        pool.post_bulk(batch.data(), 0);
+        pool.post_bulk(batch.data(), 1);
+        pool.post_bulk(batch.data() + 1, batch.size() - 1);
+    }  // the pool runs everything still queued before stopping
+    EXPECT_EQ(counter, 1000);
+}
+
+TEST_F(GraphExTest, ShouldScheduleReadyChildrenInOneBatch)
+{
+    constexpr int nChildren = 1000;
+    for (bool callerRuns : {false, true}) {
+        GraphExOptions opt;
+        opt.concurrency = 4;
+        opt.engine = ExecutionEngine::Parallel;
+        opt.callerRuns = callerRuns;
+        GraphEx executor(opt);
+
+        std::vector<std::atomic<int>> runs(nChildren);
+        std::function<int(void)> rootFunc = []() -> int { return 1; };
+        auto childFunc = [&runs](int i, int) { ++runs[i]; };
+        decltype(auto) root = executor.makeNode(rootFunc);
+        std::vector<NodeFor<decltype(childFunc)&>*> children;
+        for (int i = 0; i < nChildren; ++i) {
+            children.push_back(executor.makeNode(childFunc));
+            children.back()->setParent<1>(root);
+        }
+
+        for (int run = 1; run <= 3; ++run) {
+            for (int i = 0; i < nChildren; ++i)
+                children[i]->feed<0>(i);
+            executor.execute();
+            for (int i = 0; i < nChildren; ++i)
+                EXPECT_EQ(runs[i], run);
+            executor.reset();
+        }
+    }
+}
+
+TEST_F(GraphExTest, ThreadPoolShouldRunTasksWithAnyIdlePolicy)
+{
+    ctpl::idle_policy parkRightAway;
+    parkRightAway.spin = std::chrono::nanoseconds(0);
+    parkRightAway.yields = 0;
+    parkRightAway.adaptive = false;
+    ctpl::idle_policy spinLong;
+    spinLong.spin = std::chrono::milliseconds(1);
+    spinLong.adaptive = false;
+    for (const auto& policy :
+         {parkRightAway, spinLong, ctpl::idle_policy()}) {
+        std::atomic<int> counter = 0;
+        ctpl::thread_pool pool(4, policy);
+        // bursts of tasks, with gaps longer and shorter than the spin
+        for (int burst = 0; burst < 20; ++burst) {
+            for (int i = 0; i < 10; ++i)
+                pool.post([&counter](int) { ++counter; });
+            std::this_thread::sleep_for(std::chrono::microseconds(burst * 10));
+        }
+        pool.stop();
+        EXPECT_EQ(counter, 200);
+
+        GraphExOptions opt;
+        opt.concurrency = 4;
+        opt.engine = ExecutionEngine::Parallel;
+        opt.idlePolicy = policy;
+        GraphEx executor(opt);
+        auto addOne = [](int a) { return a + 1; };
+        decltype(auto) first = executor.makeNode(addOne);
+        decltype(auto) last = first;
+        for (int i = 0; i < 100; ++i) {
+            decltype(auto) next = executor.makeNode(addOne);
+            next->setParent<0>(last);
+            last = next;
+        }
+        for (int run = 0; run < 10; ++run) {
+            first->feed<0>(run);
+            executor.execute();
+            EXPECT_EQ(last->collect(), run + 101);
+            executor.reset();
+        }
+    }
+}
+
+TEST_F(GraphExTest, ShouldRunOnEveryQueue)
+{
+    for (auto queue : availableQueues()) {
+        std::atomic<int> counter = 0;
+        {
+            ctpl::thread_pool pool(4, ctpl::idle_policy(), queue);
+            EXPECT_EQ(pool.queue(), queue);
+            for (int i = 0; i < 100; ++i)
+                pool.post([&counter](int) { ++counter; });
+            EXPECT_EQ(pool.push([](int) { return 5; }).get(), 5);
+        }
+        EXPECT_EQ(counter, 100);
+
+        GraphExOptions opt;
+        opt.concurrency = 4;
+        opt.engine = ExecutionEngine::Parallel;
+        opt.queue = queue;
+        GraphEx executor(opt);
+        auto addOne = [](int a) { return a + 1; };
+        auto add = [](int a, int b) { return a + b; };
+        decltype(auto) source = executor.makeNode(addOne);
+        decltype(auto) sink = executor.makeNode(add);
+        decltype(auto) left = executor.makeNode(addOne);
+        decltype(auto) right = executor.makeNode(addOne);
+        left->setParent<0>(source);
+        right->setParent<0>(source);
+        sink->setParent<0>(left);
+        sink->setParent<1>(right);
+        for (int run = 0; run < 10; ++run) {
+            source->feed<0>(run);
+            executor.execute();
+            EXPECT_EQ(sink->collect(), 2 * (run + 2));
+            executor.reset();
+        }
+    }
+}
+
+TEST_F(GraphExTest, RingQueueShouldOverflowWhenFull)
+{
+    // no thread: everything stays queued until run_one
+    ctpl::thread_pool pool(0, ctpl::idle_policy(), ctpl::queue_kind::ring);
+    constexpr int nTasks = 3 * ctpl::ring_queue::capacity;
+    std::vector<int> order;
+    for (int i = 0; i < nTasks; ++i)
+        pool.post([&order, i](int) { order.push_back(i); });
+    while (pool.run_one())
+        ;
+    ASSERT_EQ(order.size(), size_t(nTasks));
+    // the ring is drained before the overflow
+    for (int i = 0; i < nTasks; ++i)
+        EXPECT_EQ(order[i], i);
+}
+
+TEST_F(GraphExTest, RingQueueShouldNotStarveOverflowWhileRingIsBusy)
+{
+    ctpl::thread_pool pool(0, ctpl::idle_policy(), ctpl::queue_kind::ring);
+    constexpr int nTasks = ctpl::ring_queue::capacity + 16;
+    // every task of the first wave posts another one as it runs, which keeps
+    // the ring full while the last ones of the wave wait in the overflow
+    std::vector<int> firstWave;
+    int nSecondWave = 0;
+    for (int i = 0; i < nTasks; ++i)
+        pool.post([&, i](int) {
+            firstWave.push_back(i);
+            pool.post([&nSecondWave](int) { ++nSecondWave; });
+        });
+    for (int i = 0; i < nTasks; ++i)
+        ASSERT_TRUE(pool.run_one());
+    // the first wave ran first, in order
+    ASSERT_EQ(firstWave.size(), size_t(nTasks));
+    for (int i = 0; i < nTasks; ++i)
+        EXPECT_EQ(firstWave[i], i);
+    EXPECT_EQ(nSecondWave, 0);
+    while (pool.run_one())
+        ;
+    EXPECT_EQ(nSecondWave, nTasks);
+}
+
+TEST_F(GraphExTest, RingQueueShouldStoreTasksInline)
+{
+    ctpl::thread_pool pool(0, ctpl::idle_policy(), ctpl::queue_kind::ring);
+    int counter = 0;
+    size_t allocationsBefore = allocationCount;
+    for (size_t i = 0; i < ctpl::ring_queue::capacity; ++i)
+        pool.post([&counter](int) { ++counter; });
+    while (pool.run_one())
+        ;
+    EXPECT_EQ(allocationCount, allocationsBefore);
+    EXPECT_EQ(counter, int(ctpl::ring_queue::capacity));
+}
+
+TEST_F(GraphExTest, ShouldNotSpinOnNodeWithPendingInputs)
+{
+    auto executor = std::make_shared<GraphEx>();
+    std::function<int(int, int)> addFunc = [](int a, int b) -> int {
+        return a + b;
+    };
+    decltype(auto) add = executor->makeNode(addFunc);
+    add->feed<0>(1);  // second input is never published
+    EXPECT_EQ(add->getState(), NodeState::Pending);
+
+    // run on a detached thread so that a node spinning on its inputs fails
+    // the test instead of hanging it
+    auto executed = std::make_shared<std::promise<bool>>();
+    auto future = executed->get_future();
+    std::thread([executor, add, executed]() {
+        try {
+            add->execute();
+            executed->set_value(true);
+        }
+        catch (const std::logic_error&) {
+            executed->set_value(false);
+        }
+    }).detach();
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(5)),
+              std::future_status::ready);
+    EXPECT_FALSE(future.get());
+    EXPECT_EQ(add->getState(), NodeState::Pending);
+
+    add->feed<1>(2);
+    executor->execute();
+    EXPECT_EQ(add->getState(), NodeState::Done);
+    EXPECT_EQ(add->collect(), 3);
+}
+
+TEST_F(GraphExTest, CallerShouldRunWholeGraphInlineWithSingleThread)
+{
+    GraphExOptions opt;
+    opt.callerRuns = true;
+    GraphEx executor(opt);
+
+    const auto callerId = std::this_thread::get_id();
+    std::vector<std::thread::id> threadIds;
+    auto record = [&threadIds]() {
+        threadIds.push_back(std::this_thread::get_id());
+    };
+    decltype(auto) first = executor.makeNode(record);
+    decltype(auto) second = executor.makeNode(record);
+    decltype(auto) third = executor.makeNode(record);
+    decltype(auto) fourth = executor.makeNode(record);
+    second->setParent(first);
+    third->setParent(first);
+    fourth->setParent(second);
+    fourth->setParent(third);
+
+    executor.execute();
+    ASSERT_EQ(threadIds.size(), 4u);
+    for (auto& id : threadIds)
+        EXPECT_EQ(id, callerId);
+}
+
+TEST_F(GraphExTest, CallerShouldRunNodesAlongsideThePool)
+{
+    constexpr int nChildren = 1'000;
+    GraphExOptions opt;
+    opt.concurrency = 4;
+    opt.callerRuns = true;
+    GraphEx executor(opt);
+
+    std::function<int(void)> rootFunc = []() -> int { return 1; };
+    decltype(auto) root = executor.makeNode(rootFunc);
+    std::atomic<int> sum = 0;
+    std::function<void(int)> leafFunc = [&sum](int a) -> void { sum += a; };
+    for (int i = 0; i < nChildren; ++i) {
+        decltype(auto) leaf = executor.makeNode(leafFunc);
+        leaf->setParent<0>(root);
+    }
+
+    for (int run = 1; run <= 3; ++run) {
+        executor.execute();
+        EXPECT_EQ(sum, run * nChildren);
+        executor.reset();
+    }
+}
+
+TEST_F(GraphExTest, CallerShouldKeepRunningNodesUntilGraphCompletes)
+{
+    constexpr int nChildren = 8;
+    GraphExOptions opt;
+    opt.concurrency = 2;  // a single worker besides the caller
+    opt.callerRuns = true;
+    opt.queue = ctpl::queue_kind::mutex;
+    GraphEx executor(opt);
+
+    const auto callerId = std::this_thread::get_id();
+    std::atomic<int> callerRunCount = 0;
+    auto childFunc = [&callerRunCount, callerId](int) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        if (std::this_thread::get_id() == callerId)
+            ++callerRunCount;
+    };
+    decltype(auto) root = executor.makeNode([]() { return 1; });
+    for (int i = 0; i < nChildren; ++i) {
+        decltype(auto) child = executor.makeNode(childFunc);
+        child->setParent<0>(root);
+    }
+
+    executor.execute();
+    // the worker does not take the whole fan-out in its batch, and the
+    // caller does not stop at the first empty look at the queue
+    EXPECT_GT(callerRunCount, 1);
+}
+
+TEST_F(GraphExTest, CallerShouldThrowIfGraphCannotComplete)
+{
+    GraphExOptions opt;
+    opt.callerRuns = true;
+    GraphEx executor(opt);
+
+    std::function<int(int)> identityFunc = [](int a) -> int { return a; };
+    decltype(auto) first = executor.makeNode(identityFunc);  // never fed
+    decltype(auto) second = executor.makeNode(identityFunc);
+    second->setParent<0>(first);
+
+    try {
+        executor.execute();
+        FAIL() << "Expected std::logic_error";
+    }
+    catch (const std::logic_error& err) {
+        EXPECT_EQ(err.what(),
+                  std::string("Graph cannot complete: some nodes are still "
+                              "waiting for their inputs"));
+    }
+}
+
+TEST_F(GraphExTest, ShouldRunWithEitherEngine)
+{
+    std::function<int(void)> secondFunc = []() -> int { return 1; };
+    std::function<int(int)> thirdFunc = [](int a) -> int { return a + 2; };
+    std::function<int(int)> fourthFunc = [](int a) -> int { return a * 2; };
+    std::function<int(int, int)> fifthFunc = [](int a, int b) -> int {
+        return a % b;
+    };
+
+    for (auto engine :
+         {ExecutionEngine::Sequential, ExecutionEngine::Parallel}) {
+        for (size_t concurrency : {1, 4}) {
+            GraphExOptions opt;
+            opt.concurrency = concurrency;
+            opt.engine = engine;
+            GraphEx executor(opt);
+
+            const auto callerId = std::this_thread::get_id();
+            std::thread::id firstThreadId;
+            decltype(auto) first = executor.makeNode([&firstThreadId]() {
+                firstThreadId = std::this_thread::get_id();
+            });
+            decltype(auto) second = executor.makeNode(secondFunc);
+            decltype(auto) third = executor.makeNode(thirdFunc);
+            decltype(auto) fourth = executor.makeNode(fourthFunc);
+            decltype(auto) fifth = executor.makeNode(fifthFunc);
+
+            second->setParent(first);
+            third->setParent<0>(second);
+            fourth->setParent<0>(second);
+            fifth->setParent<0>(third);
+            fifth->setParent<1>(fourth);
+
+            for (int run = 0; run < 2; ++run) {
+                executor.execute();
+                EXPECT_EQ(third->collect(), 3);
+                EXPECT_EQ(fourth->collect(), 2);
+                EXPECT_EQ(fifth->collect(), 1);
+                EXPECT_EQ(firstThreadId == callerId,
+                          engine == ExecutionEngine::Sequential);
+                executor.reset();
+            }
+        }
+    }
+}
+
+TEST_F(GraphExTest, SequentialEngineShouldThrowOnCycle)
+{
+    GraphEx executor;
+
+    decltype(auto) first = executor.makeNode([]() {});
+    decltype(auto) second = executor.makeNode([]() {});
+    second->setParent(first);
+    first->setParent(second);
+
+    try {
+        executor.execute();
+        FAIL() << "Expected std::logic_error";
+    }
+    catch (const std::logic_error& err) {
+        EXPECT_EQ(err.what(), std::string("Graph has a cycle"));
+    }
+}
+
+TEST_F(GraphExTest, ShouldRethrowExceptionOfTaskWithEitherEngine)
+{
+    for (auto engine :
+         {ExecutionEngine::Sequential, ExecutionEngine::Parallel}) {
+        for (bool callerRuns : {false, true}) {
+            GraphExOptions opt;
+            opt.concurrency = 2;
+            opt.engine = engine;
+            opt.callerRuns = callerRuns;
+            GraphEx executor(opt);
+
+            bool shouldThrow = true;
+            std::atomic<int> childRuns = 0;
+            decltype(auto) first = executor.makeNode([&shouldThrow]() {
+                if (shouldThrow)
+                    throw std::runtime_error("task failed");
+                return 1;
+            });
+            auto childFunc = [&childRuns](int a) {
+                ++childRuns;
+                return a + 1;
+            };
+            decltype(auto) second = executor.makeNode(childFunc);
+            decltype(auto) third = executor.makeNode(childFunc);
+            second->setParent<0>(first);
+            third->setParent<0>(second);
+
+            try {
+                executor.execute();
+                FAIL() << "Expected std::runtime_error";
+            }
+            catch (const std::runtime_error& err) {
+                EXPECT_EQ(err.what(), std::string("task failed"));
+            }
+            EXPECT_EQ(childRuns, 0);
+
+            // the graph recovers after a reset
+            shouldThrow = false;
+            executor.reset();
+            executor.execute();
+            EXPECT_EQ(third->collect(), 3);
+            EXPECT_EQ(childRuns, 2);
+        }
+    }
+}
+
+TEST_F(GraphExTest, ShouldNotCollectStaleResultAfterTaskThrew)
+{
+    for (auto engine :
+         {ExecutionEngine::Sequential, ExecutionEngine::Parallel}) {
+        GraphExOptions opt;
+        opt.concurrency = 2;
+        opt.engine = engine;
+        GraphEx executor(opt);
+
+        bool shouldThrow = false;
+        int run = 0;
+        decltype(auto) first = executor.makeNode([&]() {
+            ++run;
+            if (shouldThrow)
+                throw std::runtime_error("task failed");
+            return run;
+        });
+        decltype(auto) second =
+            executor.makeNode([](int a) -> int { return a * 10; });
+        second->setParent<0>(first);
+
+        executor.execute();
+        EXPECT_EQ(second->collect(), 10);
+
+        // the results of the first run must not pass for the second one
+        shouldThrow = true;
+        executor.reset();
+        EXPECT_THROW(executor.execute(), std::runtime_error);
+        EXPECT_NE(first->getState(), NodeState::Done);
+        EXPECT_NE(second->getState(), NodeState::Done);
+        EXPECT_THROW(first->collect(), std::logic_error);
+        EXPECT_THROW(second->collect(), std::logic_error);
+
+        shouldThrow = false;
+        executor.reset();
+        executor.execute();
+        EXPECT_EQ(second->collect(), 30);
+    }
+}
+
+TEST_F(GraphExTest, ShouldCheckDeepChainForCycle)
+{
+    constexpr int nNodes = 200'000;
+    GraphEx executor;
+
+    auto noop = []() {};
+    decltype(auto) first = executor.makeNode(noop);
+    decltype(auto) prev = first;
+    for (int i = 1; i < nNodes; ++i) {
+        decltype(auto) next = executor.makeNode(noop);
+        next->setParent(prev);
+        prev = next;
+    }
+    EXPECT_FALSE(executor.hasCycle());
+    first->setParent(prev);
+    EXPECT_TRUE(executor.hasCycle());
+}
+
+TEST_F(GraphExTest, SetParentShouldRejectCycleInIncrementalMode)
+{
+    GraphExOptions opt;
+    opt.incrementalCycleCheck = true;
+    GraphEx executor(opt);
+
+    std::function<int(void)> sourceFunc = []() -> int { return 1; };
+    std::function<int(int)> incFunc = [](int a) -> int { return a + 1; };
+    // declared in reverse order, so that most edges reorder the nodes
+    decltype(auto) third = executor.makeNode(incFunc);
+    decltype(auto) second = executor.makeNode(incFunc);
+    decltype(auto) first = executor.makeNode(incFunc);
+    decltype(auto) source = executor.makeNode(sourceFunc);
+    third->setParent<0>(second);
+    second->setParent<0>(first);
+    first->setParent<0>(source);
+
+    EXPECT_THROW(source->setParent(third), std::logic_error);
+    EXPECT_THROW(first->setParent(first), std::logic_error);
+    EXPECT_FALSE(executor.hasCycle());
+
+    executor.execute();
+    EXPECT_EQ(third->collect(), 4);
+}
+
+static int addOne(int a) { return a + 1; }
+
+struct Accumulator {
+    int add(int a) { return total += a; }
+    int get() const { return total; }
+    int total = 0;
+};
+
+TEST_F(GraphExTest, ShouldAcceptAnyCallable)
+{
+    GraphEx executor(2);
+    Accumulator accumulator;
+
+    decltype(auto) source = executor.makeNode([]() { return 41; });
+    decltype(auto) inc = executor.makeNode(&addOne);
+    decltype(auto) add = executor.makeNode(&Accumulator::add);
+    decltype(auto) get = executor.makeNode(&Accumulator::get);
+    int factor = 2;
+    decltype(auto) twice = executor.makeNode(
+        [factor](const int& a) mutable { return a * factor; });
+    // the callables are stored as they are, not wrapped in std::function
+    static_assert(
+        std::is_same_v<decltype(inc), Node<int (*)(int), int>*>);
+    static_assert(std::is_same_v<decltype(add),
+                                 Node<int (Accumulator::*)(int),
+                                      Accumulator*,
+                                      int>*>);
+    inc->setParent<0>(source);
+    add->setParent<1>(inc);
+    get->setParent(add);
+    twice->setParent<0>(get);
+
+    add->feed<0>(&accumulator);
+    get->feed<0>(&accumulator);
+    executor.execute();
+    EXPECT_EQ(twice->collect(), 84);
+    EXPECT_EQ(accumulator.total, 42);
+}
+
+TEST_F(GraphExTest, CompileShouldProduceTopologicalPlan)
+{
+    GraphEx executor(2);
+
+    std::function<int(void)> sourceFunc = []() -> int { return 1; };
+    std::function<int(int, int)> addFunc = [](int a, int b) -> int {
+        return a + b;
+    };
+    // declared in reverse order on purpose
+    decltype(auto) sink = executor.makeNode(addFunc);
+    decltype(auto) left = executor.makeNode(sourceFunc);
+    decltype(auto) right = executor.makeNode(sourceFunc);
+    decltype(auto) after = executor.makeNode([]() {});
+    sink->setParent<0>(left);
+    sink->setParent<1>(right);
+    after->setParent(sink);
+
+    const ExecutionPlan& plan = executor.compile();
+    ASSERT_EQ(plan.nodes.size(), 4u);
+    ASSERT_EQ(plan.childOffsets.size(), 5u);
+    EXPECT_EQ(plan.roots.size(), 2u);
+    std::unordered_map<BaseNode*, uint32_t> position;
+    for (uint32_t i = 0; i < plan.nodes.size(); ++i)
+        position[plan.nodes[i].node] = i;
+    for (uint32_t i = 0; i < plan.nodes.size(); ++i)
+        for (uint32_t k = plan.childOffsets[i]; k < plan.childOffsets[i + 1];
+             ++k)
+            EXPECT_LT(i, plan.children[k]);
+    EXPECT_EQ(plan.inDegrees[position[sink]], 2u);
+    // the pending count a node starts a run with
+    EXPECT_EQ(sink->getPendingCount(), 2u);
+    EXPECT_EQ(after->getPendingCount(), 1u);
+    EXPECT_EQ(&executor.compile(), &plan);  // kept until the graph changes
+
+    executor.execute();
+    EXPECT_EQ(sink->collect(), 2);
+}
+
+TEST_F(GraphExTest, ResetShouldStartANewRunLazily)
+{
+    for (size_t concurrency : {1, 3}) {
+        GraphEx executor(concurrency);
+        std::function<int(int)> doubleFunc = [](int a) -> int {
+            return a * 2;
+        };
+        std::function<int(int, int)> addFunc = [](int a, int b) -> int {
+            return a + b;
+        };
+        decltype(auto) source = executor.makeNode(doubleFunc);
+        decltype(auto) left = executor.makeNode(doubleFunc);
+        decltype(auto) sink = executor.makeNode(addFunc);
+        left->setParent<0>(source);
+        sink->setParent<0>(left);
+        sink->setParent<1>(source);
+
+        for (int run = 1; run <= 100; ++run) {
+            source->feed<0>(run);
+            executor.execute();
+            EXPECT_EQ(sink->getState(), NodeState::Done);
+            EXPECT_EQ(sink->collect(), 6 * run);
+
+            executor.reset();
+            // nodes are untouched by the reset, yet look pending again
+            EXPECT_EQ(sink->getState(), NodeState::Pending);
+            EXPECT_EQ(sink->getPendingCount(), 2u);
+            EXPECT_EQ(source->getPendingCount(), 1u);
+            EXPECT_THROW(sink->collect(), std::logic_error);
+        }
+    }
+}
+
+TEST_F(GraphExTest, ShouldBuildGraphInItsArena)
+{
+    constexpr int nNodes = 10'000;
+    std::atomic<int> sum = 0;
+    auto addOne = [&sum](int a) {
+        ++sum;
+        return a + 1;
+    };
+    size_t allocationsBefore = allocationCount;
+    {
+        GraphEx executor(1);
+        decltype(auto) first = executor.makeNode(addOne, "first node");
+        decltype(auto) last = first;
+        for (int i = 1; i < nNodes; ++i) {
+            decltype(auto) next = executor.makeNode(
+                addOne, "a node name too long for any small string buffer");
+            next->setParent<0>(last);
+            last = next;
+        }
+        // nodes, edges and names come from a few large blocks
+        EXPECT_LT(allocationCount - allocationsBefore, size_t(100));
+        EXPECT_EQ(first->getName(), "first node");
+        EXPECT_EQ(last->getName(),
+                  "a node name too long for any small string buffer");
+
+        first->feed<0>(0);
+        executor.execute();
+        EXPECT_EQ(last->collect(), nNodes);
+    }
+    EXPECT_EQ(sum, nNodes);
+}
+
+TEST_F(GraphExTest, ShouldReportMemoryOfCompactNodes)
+{
+    // a node taking and returning an int before the compact layout: the
+    // callable in a std::function, the name in a std::string, the children
+    // and the callbacks signaling them in std::vectors
+    struct BaselineNode {
+        virtual ~BaselineNode() = default;
+        std::vector<void*> nextNodes;
+        std::string name;
+        std::function<int(int)> task;
+        std::tuple<int> args;
+        std::optional<int> result;
+        void* executor;
+        size_t parentCount;
+        std::atomic<size_t> pendingCount;
+        std::vector<std::function<void(int)>> childTasks;
+        std::vector<std::function<void()>> noArgChildTasks;
+    };
+    constexpr size_t kBaselineNodeSize = sizeof(BaselineNode);
+    GraphEx executor(1);
+    auto voidFunc = []() {};
+    auto intFunc = [](int a) { return a; };
+    // a void node has no room for a result
+    EXPECT_LT(sizeof(NodeFor<decltype(voidFunc)>),
+              sizeof(NodeFor<decltype(intFunc)>));
+    // the name and the callbacks are gone, at the very least
+    EXPECT_LE(sizeof(NodeFor<decltype(intFunc)>),
+              kBaselineNodeSize - sizeof(std::string) -
+                  2 * sizeof(std::vector<void*>));
+    EXPECT_LT(sizeof(NodeFor<std::function<int(int, int)>>),
+              kBaselineNodeSize);
+
+    decltype(auto) source = executor.makeNode(intFunc, "shared name");
+    decltype(auto) sink = executor.makeNode(voidFunc, "shared name");
+    for (int i = 0; i < 100; ++i) {
+        decltype(auto) node = executor.makeNode(intFunc, "shared name");
+        node->setParent<0>(source);
+        sink->setParent(node);
+    }
+    EXPECT_EQ(sink->getName(), "shared name");
+
+    MemoryReport report = executor.memoryReport();
+    EXPECT_EQ(report.nodeCount, size_t(102));
+    EXPECT_EQ(report.edgeCount, size_t(200));
+    EXPECT_EQ(report.planBytes, size_t(0));
+    EXPECT_LE(report.nodeBytes, 102 * sizeof(NodeFor<decltype(intFunc)>));
+    // the name is stored once for all the nodes
+    EXPECT_LT(report.nameBytes, size_t(1024));
+    // an id to the child per edge, plus the argument edges of the source.
+    // Arrays double their capacity and leave their buffers behind, which
+    // takes up to 4 times the live edges
+    EXPECT_LE(report.bytesPerEdge(),
+              4.0 * (sizeof(uint32_t) + sizeof(detail::ArgumentEdge)));
+    // bookkeeping of the graph included, a node takes less than it used to
+    // on its own
+    EXPECT_LT(report.bytesPerNode(), double(kBaselineNodeSize));
+
+    executor.compile();
+    EXPECT_GT(executor.memoryReport().planBytes, size_t(0));
+}
+
+TEST_F(GraphExTest, ShouldNotAllocateWhenSchedulingNodes)
+{
+    constexpr int nLeaves = 256;
+    constexpr int nWarmUpRuns = 5;
+    constexpr int nRuns = 200;
+    constexpr int nThreads = 4;
+    for (auto queue : availableQueues()) {
+        for (bool callerRuns : {false, true}) {
+            GraphExOptions opt;
+            opt.concurrency = nThreads;
+            opt.engine = ExecutionEngine::Parallel;
+            opt.callerRuns = callerRuns;
+            opt.queue = queue;
+            GraphEx executor(opt);
+
+            std::atomic<int> sum = 0;
+            auto leafFunc = [&sum](int a) { sum += a; };
+            decltype(auto) root = executor.makeNode([]() { return 1; });
+            decltype(auto) sink = executor.makeNode([]() {});
+            for (int i = 0; i < nLeaves; ++i) {
+                decltype(auto) leaf = executor.makeNode(leafFunc);
+                leaf->setParent<0>(root);
+                sink->setParent(leaf);
+            }
+            // the queues of the pool grow during the first runs
+            for (int run = 0; run < nWarmUpRuns; ++run) {
+                executor.execute();
+                executor.reset();
+            }
+
+            size_t allocationsBefore = allocationCount;
+            for (int run = 0; run < nRuns; ++run) {
+                executor.execute();
+                executor.reset();
+            }
+            size_t allocations = allocationCount - allocationsBefore;
+            if (queue == ctpl::queue_kind::work_stealing) {
+                // the fan-out lands on the deque of whichever worker ran the
+                // root, so a deque can still grow the first time that worker
+                // runs it: at most the doublings from 16 to nLeaves cells, for
+                // every deque and the injection queue. It does not depend on
+                // the number of runs
+                EXPECT_LE(allocations, size_t(5 * (nThreads + 1)));
+            }
+            else {
+                EXPECT_EQ(allocations, 0u);
+            }
+            EXPECT_EQ(sum, (nWarmUpRuns + nRuns) * nLeaves);
+        }
+    }
+}
+
+TEST_F(GraphExTest, ShouldRewindExecutionResourceAcrossRuns)
+{
+    constexpr int nRuns = 50;
+    for (size_t concurrency : {1, 3}) {
+        GraphEx executor(concurrency);
+        std::pmr::memory_resource* resource = executor.executionResource();
+        decltype(auto) source = executor.makeNode([resource](int n) {
+            // a temporary and the result, both from the resource
+            std::pmr::vector<int> scratch(n, 1, resource);
+            return std::pmr::vector<int>(scratch.begin(), scratch.end(),
+                                         resource);
+        });
+        std::atomic<int> sum = 0;
+        for (int i = 0; i < 3; ++i) {
+            decltype(auto) sink =
+                executor.makeNode([&sum](const std::pmr::vector<int>& v) {
+                    for (int x : v)
+                        sum += x;
+                });
+            sink->setParent<0>(source);
+        }
+
+        source->feed<0>(10'000);
+        executor.execute();
+        size_t reserved = executor.memoryReport().executionBytes;
+        EXPECT_GE(reserved, 2 * 10'000 * sizeof(int));
+        for (int run = 0; run < nRuns; ++run) {
+            executor.resetAndRewind();
+            source->feed<0>(10'000);
+            executor.execute();
+            EXPECT_EQ(source->collect().size(), size_t(10'000));
+        }
+        // every run is served from the blocks of the first one
+        EXPECT_EQ(executor.memoryReport().executionBytes, reserved);
+        EXPECT_EQ(sum, (nRuns + 1) * 3 * 10'000);
+
+        // a plain reset leaves the memory of the previous runs alone
+        for (int run = 0; run < 3; ++run) {
+            executor.reset();
+            source->feed<0>(10'000);
+            executor.execute();
+        }
+        EXPECT_GT(executor.memoryReport().executionBytes, reserved);
+    }
+}
+
+TEST_F(GraphExTest, ShouldAllocateFromExecutionResourceConcurrently)
+{
+    constexpr int nNodes = 64;
+    GraphEx executor(4);
+    std::pmr::memory_resource* resource = executor.executionResource();
+    std::atomic<int> mismatches = 0;
+    for (int i = 0; i < nNodes; ++i) {
+        decltype(auto) source = executor.makeNode([resource, i]() {
+            // small and large blocks, so that threads move on between blocks
+            std::pmr::vector<int> v(resource);
+            for (int n = 0; n < 50; ++n)
+                v.push_back(i);
+            std::pmr::vector<int> large(i * 1'000, i, resource);
+            v.insert(v.end(), large.begin(), large.end());
+            return v;
+        });
+        decltype(auto) sink =
+            executor.makeNode([&mismatches, i](const std::pmr::vector<int>& v) {
+                if (v.size() != size_t(50 + i * 1'000) ||
+                    std::any_of(v.begin(), v.end(),
+                                [i](int x) { return x != i; }))
+                    ++mismatches;
+            });
+        sink->setParent<0>(source);
+    }
+    for (int run = 0; run < 10; ++run) {
+        executor.execute();
+        executor.resetAndRewind();
+    }
+    // no two nodes were handed overlapping memory
+    EXPECT_EQ(mismatches, 0);
+}
+
+TEST_F(GraphExTest, ShouldRecycleResultsThroughPool)
+{
+    constexpr int nRuns = 50;
+    GraphEx executor(1);
+    ResultPool<std::vector<int>> pool;
+    decltype(auto) source = executor.makeNode([&pool](int n) {
+        std::vector<int> v = pool.acquire();
+        v.assign(n, n);
+        return v;
+    });
+    source->setResultPool(&pool);
+    long long sum = 0;
+    decltype(auto) sink =
+        executor.makeNode([&sum](const std::vector<int>& v) {
+            for (int x : v)
+                sum += x;
+        });
+    sink->setParent<0>(source);
+
+    // the result of the first run is pooled by the second one
+    for (int run = 0; run < 2; ++run) {
+        source->feed<0>(1000);
+        executor.execute();
+        executor.reset();
+    }
+    EXPECT_EQ(pool.size(), 0u);
+
+    size_t allocationsBefore = allocationCount;
+    for (int run = 0; run < nRuns; ++run) {
+        source->feed<0>(1000);
+        executor.execute();
+        executor.reset();
+    }
+    // the buffers of the result and of the argument of the sink are reused
+    EXPECT_EQ(allocationCount - allocationsBefore, 0u);
+    EXPECT_EQ(sum, (nRuns + 2) * 1000LL * 1000);
+
+    source->feed<0>(1000);
+    executor.execute();
+    EXPECT_EQ(source->collect().size(), size_t(1000));
+}
+
+// value holding a payload, counting the payloads alive at the same time
+struct TrackedPayload {
+    static inline int live = 0;
+    static inline int peak = 0;
+
+    TrackedPayload() = default;
+    explicit TrackedPayload(int) : loaded(true) { add(); }
+    TrackedPayload(const TrackedPayload& other) : loaded(other.loaded)
+    {
+        if (loaded)
+            add();
+    }
+    TrackedPayload(TrackedPayload&& other) noexcept
+        : loaded(std::exchange(other.loaded, false))
+    {
+    }
+    TrackedPayload& operator=(const TrackedPayload& other)
+    {
+        TrackedPayload copy(other);
+        return *this = std::move(copy);
+    }
+    TrackedPayload& operator=(TrackedPayload&& other) noexcept
+    {
+        if (loaded)
+            --live;
+        loaded = std::exchange(other.loaded, false);
+        return *this;
+    }
+    ~TrackedPayload()
+    {
+        if (loaded)
+            --live;
+    }
+
+    static void add() { peak = std::max(peak, ++live); }
+
+    bool loaded = false;
+};
+
+TEST_F(GraphExTest, ShouldReleaseIntermediateResultsOnceConsumed)
+{
+    constexpr int nNodes = 10;
+    for (bool releaseIntermediates : {false, true}) {
+        GraphExOptions opt;
+        opt.releaseIntermediates = releaseIntermediates;
+        GraphEx executor(opt);
+        auto first = executor.makeNode([]() { return TrackedPayload(1); });
+        auto forward = [](const TrackedPayload&) { return TrackedPayload(1); };
+        std::vector<NodeFor<decltype(forward)>*> chain;
+        for (int i = 1; i < nNodes; ++i) {
+            chain.push_back(executor.makeNode(forward));
+            if (i == 1)
+                chain.back()->setParent<0>(first);
+            else
+                chain.back()->setParent<0>(chain[chain.size() - 2]);
+        }
+        chain[nNodes / 2]->markAsOutput();
+
+        TrackedPayload::peak = 0;
+        executor.execute();
+        if (releaseIntermediates) {
+            // the output, plus an argument and the result being handed over
+            EXPECT_LE(TrackedPayload::peak, 3);
+            // the output and the last node, which has no consumer
+            EXPECT_EQ(TrackedPayload::live, 2);
+            EXPECT_THROW(chain[0]->collect(), std::logic_error);
+        }
+        else {
+            // every result, and a copy as argument of every child
+            EXPECT_EQ(TrackedPayload::live, 2 * nNodes - 1);
+            EXPECT_TRUE(chain[0]->collect().loaded);
+        }
+        EXPECT_TRUE(chain[nNodes / 2]->collect().loaded);
+        EXPECT_TRUE(chain.back()->collect().loaded);
+
+        executor.reset();
+        executor.execute();
+        EXPECT_TRUE(chain[nNodes / 2]->collect().loaded);
+    }
+    EXPECT_EQ(TrackedPayload::live, 0);
+}
+
+// value counting how many times it is copied
+struct CopyCounted {
+    static inline int copies = 0;
+
+    CopyCounted() = default;
+    explicit CopyCounted(int v) : value(v) {}
+    CopyCounted(const CopyCounted& other) : value(other.value) { ++copies; }
+    CopyCounted(CopyCounted&&) = default;
+    CopyCounted& operator=(const CopyCounted& other)
+    {
+        ++copies;
+        value = other.value;
+        return *this;
+    }
+    CopyCounted& operator=(CopyCounted&&) = default;
+
+    int value = 0;
+};
+
+TEST_F(GraphExTest, ShouldMoveResultIntoLastConsumer)
+{
+    struct Case {
+        bool releaseIntermediates;
+        bool output;
+        int expectedCopies;
+    };
+    // a copy for every consumer but the last, plus one when the result is
+    // kept in the node
+    for (Case c : {Case{false, false, 3}, Case{true, false, 2},
+                   Case{true, true, 3}}) {
+        GraphExOptions opt;
+        opt.releaseIntermediates = c.releaseIntermediates;
+        GraphEx executor(opt);
+        decltype(auto) source =
+            executor.makeNode([]() { return CopyCounted(7); });
+        if (c.output)
+            source->markAsOutput();
+        std::atomic<int> sum = 0;
+        decltype(auto) byValue =
+            executor.makeNode([&sum](CopyCounted a) { sum += a.value; });
+        decltype(auto) byReference = executor.makeNode(
+            [&sum](const CopyCounted& a) { sum += a.value; });
+        decltype(auto) byRvalue = executor.makeNode([&sum](CopyCounted&& a) {
+            CopyCounted taken(std::move(a));
+            sum += taken.value;
+        });
+        byValue->setParent<0>(source);
+        byReference->setParent<0>(source);
+        byRvalue->setParent<0>(source);
+
+        for (int run = 0; run < 2; ++run) {
+            CopyCounted::copies = 0;
+            executor.execute();
+            EXPECT_EQ(CopyCounted::copies, c.expectedCopies);
+            EXPECT_EQ(sum, 3 * 7 * (run + 1));
+            if (c.releaseIntermediates && !c.output)
+                EXPECT_THROW(source->collect(), std::logic_error);
+            else
+                EXPECT_EQ(source->collect().value, 7);
+            executor.reset();
+        }
+    }
+}
+
+TEST_F(GraphExTest, InplaceTaskShouldStoreSmallFunctorsInline)
+{
+    int calls = 0;
+    auto small = [&calls](int id) { calls += id; };
+    size_t allocationsBefore = allocationCount;
+    ctpl::inplace_task task(small);
+    ctpl::inplace_task moved(std::move(task));
+    moved(2);
+    EXPECT_EQ(allocationCount - allocationsBefore, 0u);
+    EXPECT_FALSE(task);
+    EXPECT_EQ(calls, 2);
+
+    // too large to be kept inline, moved to the heap
+    std::array<char, 2 * ctpl::inplace_task::capacity> payload{};
+    auto large = [&calls, payload](int id) { calls += id + payload[0]; };
+    ctpl::inplace_task heapTask(large);
+    EXPECT_GT(allocationCount - allocationsBefore, 0u);
+    heapTask(3);
+    EXPECT_EQ(calls, 5);
+}
+
+TEST_F(GraphExTest, ShouldGatherManyParentsThroughFanInCounters)
+{
+    constexpr int nParents = 10'000;
+    for (auto engine :
+         {ExecutionEngine::Sequential, ExecutionEngine::Parallel}) {
+        GraphExOptions opt;
+        opt.concurrency = 4;
+        opt.engine = engine;
+        opt.fanInThreshold = 100;
+        GraphEx executor(opt);
+
+        std::atomic<int> count = 0;
+        int sinkRuns = 0;
+        auto parentFunc = [&count]() { ++count; };
+        decltype(auto) sink = executor.makeNode([&](int extra) {
+            ++sinkRuns;
+            return count.load() + extra;
+        });
+        for (int i = 0; i < nParents; ++i)
+            sink->setParent(executor.makeNode(parentFunc));
+
+        // fed before the plan groups the parents of the sink
+        sink->feed<0>(1);
+        const ExecutionPlan& plan = executor.compile();
+        EXPECT_EQ(plan.signalCounts.back(), 100u);
+        EXPECT_EQ(plan.fanInCounters.size(), 100u);
+        EXPECT_EQ(sink->getPendingCount(), 100u);
+
+        for (int run = 1; run <= 3; ++run) {
+            executor.execute();
+            EXPECT_EQ(sink->collect(), run * nParents + run);
+            EXPECT_EQ(sinkRuns, run);
+            executor.reset();
+            sink->feed<0>(run + 1);
+        }
+    }
+}
+
 auto main(int argc, char** argv) -> int
 {
     ::testing::InitGoogleTest(&argc, argv);